@@ -0,0 +1,234 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+#include "SmallType.h"
+
+// Bulk decoding has an AVX2 path, compiled per function and picked at runtime
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define PACKED_ARRAY_AVX2 1
+#include <immintrin.h>
+#endif
+
+// Number of bits needed to write N, and at least 1
+constexpr unsigned packed_bits(unsigned long long N) {
+	unsigned bits = 1;
+	while (N >>= 1) ++bits;
+	return bits;
+}
+
+/*
+ * Array of integers in [0, MaxValue] that stores every element in exactly ceil(log2(MaxValue + 1)) bits
+ * Elements are laid out back to back in 64-bit words (little-endian bit order) and may straddle two of them,
+ * values come out as the smallest standard type that holds MaxValue (see SmallType)
+ */
+template <unsigned long long MaxValue>
+class PackedArray {
+	public:
+		using value_type = SmallType_t<MaxValue>;
+		using word_type = SmallType_t<ULLONG_MAX>;
+		using size_type = size_t;
+
+		static constexpr unsigned bits = packed_bits(MaxValue);
+
+	private:
+		static_assert(sizeof(word_type) * CHAR_BIT == 64, "PackedArray needs a 64-bit word type");
+
+		static constexpr word_type mask = bits == 64 ? ~word_type{} : (word_type{ 1 } << bits) - 1;
+
+		// Words past the last element, so a straddling read and the vector decoder's 16-byte loads stay in bounds
+		static constexpr size_t padding = 4;
+
+		std::vector<word_type> words = std::vector<word_type>(padding);
+		size_t count = 0;
+
+		static size_t words_for(size_t n) { return (n * bits + 63) / 64 + padding; }
+
+		static word_type extract(const word_type* w, size_t bit) {
+			auto i = bit / 64, off = bit % 64;
+			auto v = w[i] >> off;
+			if (off + bits > 64) v |= w[i + 1] << (64 - off);
+			return v & mask;
+		}
+
+		static void insert(word_type* w, size_t bit, word_type v) {
+			auto i = bit / 64, off = bit % 64;
+			w[i] = (w[i] & ~(mask << off)) | (v << off);
+			if (off + bits > 64) w[i + 1] = (w[i + 1] & ~(mask >> (64 - off))) | (v >> (64 - off));
+		}
+
+	public:
+		// Proxy returned by the non-const operator[]
+		class reference {
+			PackedArray* array;
+			size_t index;
+
+			public:
+				reference(PackedArray* array, size_t index) : array{ array }, index{ index } {}
+
+				operator value_type() const { return array->get(index); }
+				reference& operator=(value_type v) { array->set(index, v); return *this; }
+				reference& operator=(const reference& other) { return *this = static_cast<value_type>(other); }
+		};
+
+		// Random-access iterator over the values, dereferencing decodes
+		class const_iterator {
+			const PackedArray* array = nullptr;
+			size_t index = 0;
+
+			public:
+				using iterator_category = std::random_access_iterator_tag;
+				using value_type = PackedArray::value_type;
+				using difference_type = std::ptrdiff_t;
+				using pointer = void;
+				using reference = value_type;
+
+				const_iterator() = default;
+				const_iterator(const PackedArray* array, size_t index) : array{ array }, index{ index } {}
+
+				value_type operator*() const { return array->get(index); }
+				value_type operator[](difference_type n) const { return array->get(index + n); }
+
+				const_iterator& operator++() { ++index; return *this; }
+				const_iterator operator++(int) { auto old = *this; ++index; return old; }
+				const_iterator& operator--() { --index; return *this; }
+				const_iterator operator--(int) { auto old = *this; --index; return old; }
+				const_iterator& operator+=(difference_type n) { index += n; return *this; }
+				const_iterator& operator-=(difference_type n) { index -= n; return *this; }
+
+				friend const_iterator operator+(const_iterator it, difference_type n) { return it += n; }
+				friend const_iterator operator+(difference_type n, const_iterator it) { return it += n; }
+				friend const_iterator operator-(const_iterator it, difference_type n) { return it -= n; }
+				friend difference_type operator-(const const_iterator& a, const const_iterator& b) {
+					return static_cast<difference_type>(a.index) - static_cast<difference_type>(b.index);
+				}
+
+				friend bool operator==(const const_iterator& a, const const_iterator& b) { return a.index == b.index; }
+				friend bool operator!=(const const_iterator& a, const const_iterator& b) { return a.index != b.index; }
+				friend bool operator<(const const_iterator& a, const const_iterator& b) { return a.index < b.index; }
+				friend bool operator>(const const_iterator& a, const const_iterator& b) { return a.index > b.index; }
+				friend bool operator<=(const const_iterator& a, const const_iterator& b) { return a.index <= b.index; }
+				friend bool operator>=(const const_iterator& a, const const_iterator& b) { return a.index >= b.index; }
+		};
+
+		using iterator = const_iterator;
+
+		PackedArray() = default;
+		explicit PackedArray(size_t n, value_type value = 0) { resize(n, value); }
+
+		// Only takes iterators, so PackedArray(n, value) with two ints still means n copies of value
+		template <class It, class = typename std::iterator_traits<It>::iterator_category>
+		PackedArray(It first, It last) {
+			if constexpr (std::is_base_of_v<std::forward_iterator_tag, typename std::iterator_traits<It>::iterator_category>) {
+				words.reserve(words_for(std::distance(first, last)));
+			}
+			for (; first != last; ++first) push_back(static_cast<value_type>(*first));
+		}
+
+		size_t size() const { return count; }
+		bool empty() const { return !count; }
+
+		// Bytes of storage, padding included
+		size_t bytes_used() const { return words.capacity() * sizeof(word_type); }
+
+		value_type get(size_t i) const {
+			assert(i < count);
+			return static_cast<value_type>(extract(words.data(), i * bits));
+		}
+
+		void set(size_t i, value_type value) {
+			assert(i < count && value <= MaxValue);
+			insert(words.data(), i * bits, value);
+		}
+
+		value_type operator[](size_t i) const { return get(i); }
+		reference operator[](size_t i) { return { this, i }; }
+
+		void push_back(value_type value) {
+			if (words.size() < words_for(count + 1)) words.resize(words_for(count + 1));
+			++count;
+			set(count - 1, value);
+		}
+
+		// Shrinking keeps the words, set() masks out whatever dropped elements left behind
+		void resize(size_t n, value_type value = 0) {
+			auto old = count;
+			words.resize(std::max(words.size(), words_for(n)));
+			count = n;
+			for (auto i = old; i < n; ++i) set(i, value);
+		}
+
+		void clear() { resize(0); }
+
+		const_iterator begin() const { return { this, 0 }; }
+		const_iterator end() const { return { this, count }; }
+
+		/*
+		 * Decode elements [first, first + n) into out, which may be any integer type at least as wide as value_type
+		 * Element widths up to 25 bits decode 8 at a time with AVX2 when the CPU has it and out holds 32-bit values
+		 */
+		template <class T>
+		void decode(size_t first, size_t n, T* out) const {
+			static_assert(std::is_integral_v<T> && sizeof(T) >= sizeof(value_type), "decode needs a wide enough integer buffer");
+			assert(first + n <= count);
+
+			auto bit = first * bits;
+#ifdef PACKED_ARRAY_AVX2
+			if constexpr (bits <= 25 && sizeof(T) == 4) {
+				if (n >= 16 && has_avx2()) {
+					// Decode up to a group boundary, where the bit position is a whole number of bytes again
+					for (; first % 8; ++first, --n, bit += bits) *out++ = static_cast<T>(extract(words.data(), bit));
+
+					auto groups = n / 8;
+					decode_avx2(reinterpret_cast<const unsigned char*>(words.data()) + bit / 8, groups, reinterpret_cast<uint32_t*>(out));
+					out += groups * 8;
+					bit += groups * 8 * bits;
+					n -= groups * 8;
+				}
+			}
+#endif
+			// The rest, one or two word reads per element
+			for (; n; --n, bit += bits) *out++ = static_cast<T>(extract(words.data(), bit));
+		}
+
+	private:
+#ifdef PACKED_ARRAY_AVX2
+		static bool has_avx2() {
+			static const bool supported = __builtin_cpu_supports("avx2");
+			return supported;
+		}
+
+		// Every 8 elements take exactly `bits` bytes, so each group starts on a byte. Element k of a group lies in the
+		// 4 bytes at k * bits / 8, shifted by k * bits % 8. Elements 0-3 are gathered from a 16-byte load at the group
+		// and 4-7 from one at byte 4 * bits / 8, with one in-lane shuffle, a variable shift and a mask
+		__attribute__((target("avx2")))
+		static void decode_avx2(const unsigned char* in, size_t groups, uint32_t* out) {
+			constexpr unsigned half = 4 * bits / 8;
+
+			alignas(32) char index[32];
+			alignas(32) uint32_t shifts[8];
+			for (unsigned k = 0; k != 8; ++k) {
+				auto byte = k * bits / 8 - (k < 4 ? 0 : half);
+				for (unsigned b = 0; b != 4; ++b) index[4 * k + b] = static_cast<char>(byte + b);
+				shifts[k] = k * bits % 8;
+			}
+
+			auto shuffle = _mm256_load_si256(reinterpret_cast<const __m256i*>(index));
+			auto shift = _mm256_load_si256(reinterpret_cast<const __m256i*>(shifts));
+			auto keep = _mm256_set1_epi32(static_cast<int>(mask));
+			for (size_t g = 0; g != groups; ++g, in += bits, out += 8) {
+				auto lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+				auto hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + half));
+				auto v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+				v = _mm256_and_si256(_mm256_srlv_epi32(_mm256_shuffle_epi8(v, shuffle), shift), keep);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(out), v);
+			}
+		}
+#endif
+};
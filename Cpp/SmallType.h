@@ -1,34 +1,20 @@
 #pragma once
 
 #include <climits>
+#include <type_traits>
 
-constexpr unsigned long long max(const unsigned long long N) {
-	return N <= UCHAR_MAX ? UCHAR_MAX
-	     : N <= UINT_MAX  ? UINT_MAX
-	     : N <= ULONG_MAX ? ULONG_MAX : ULLONG_MAX;
-}
-
+/*
+ * Smallest unsigned standard integer type that can hold values up to N
+ * Picked with a chain of conditionals, since some of the limits are equal on common platforms (ULONG_MAX is
+ * ULLONG_MAX on LP64, UINT_MAX is ULONG_MAX on Windows) and specializing on each of them would redefine one
+ */
 template <unsigned long long N>
-class SmallType {
-	using type = SmallType<max(N)>::type;
-};
-
-template <>
-class SmallType<UCHAR_MAX> {
-	using type = unsigned char;
-};
-
-template <>
-class SmallType<UINT_MAX> {
-	using type = unsigned int;
+struct SmallType {
+	using type = std::conditional_t<N <= UCHAR_MAX, unsigned char,
+	             std::conditional_t<N <= USHRT_MAX, unsigned short,
+	             std::conditional_t<N <= UINT_MAX, unsigned int,
+	             std::conditional_t<N <= ULONG_MAX, unsigned long, unsigned long long>>>>;
 };
 
-template <>
-class SmallType<ULONG_MAX> {
-	using type = unsigned long;
-};
-
-template <>
-class SmallType<ULLONG_MAX> {
-	using type = unsigned long long;
-};
+template <unsigned long long N>
+using SmallType_t = typename SmallType<N>::type;
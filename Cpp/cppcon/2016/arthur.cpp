@@ -1,65 +1,584 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <regex>
+#include <stdexcept>
 #include <string>
-#include <set>
+#include <string_view>
+#include <vector>
 
 #include <assert.h>
 
-bool isWordChar(char& c) {
-    return std::isalnum(c) || c == '_';
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Bytes are classified 16 or 32 bytes at a time on x86-64, SSE2 is always there and AVX2 is picked at runtime
+#if defined(__x86_64__) || defined(_M_X64)
+#define WORDS_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define WORDS_TARGET(isa)
+#else
+#define WORDS_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+// ASCII only, unlike std::isalnum it doesn't depend on the locale or break on negative chars
+bool isWordChar(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// Index of the lowest set bit, x must not be 0
+unsigned lowest_bit(uint64_t x) {
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward64(&i, x);
+    return i;
+#else
+    return __builtin_ctzll(x);
+#endif
+}
+
+// Index of the highest set bit, x must not be 0
+unsigned highest_bit(uint64_t x) {
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanReverse64(&i, x);
+    return i;
+#else
+    return 63 - __builtin_clzll(x);
+#endif
+}
+
+// The whitespace of std::isspace in the "C" locale
+bool isSpaceChar(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+// Digit and space bitmasks of a 64-byte block
+struct DigitMasks {
+    uint64_t digit = 0, space = 0;
+};
+
+// Bit i of the result is set when p[i] is a word char, for the 64 bytes starting at p
+uint64_t word_mask_scalar(const char* p) {
+    uint64_t mask = 0;
+    for (unsigned i = 0; i < 64; ++i) mask |= uint64_t(isWordChar(p[i])) << i;
+    return mask;
 }
 
-bool all_words_unique(std::string s) {
-    std::set<std::string> uniq;
-    
-    auto front = std::begin(s);
-    const auto back = std::end(s);
-    while (front != back) {
-        auto word_end = std::find_if(front, back, [](auto& c) { return !isWordChar(c); });
-        
-        std::string word{ front, word_end };
-        if (uniq.count(word)) return false;
-        uniq.insert(word);
-        
-        front = std::find_if(word_end, back, [](auto& c) { return isWordChar(c); });
+DigitMasks digit_masks_scalar(const char* p) {
+    DigitMasks masks;
+    for (unsigned i = 0; i < 64; ++i) {
+        masks.digit |= uint64_t(p[i] >= '0' && p[i] <= '9') << i;
+        masks.space |= uint64_t(isSpaceChar(p[i])) << i;
     }
-    
-    return true;
+    return masks;
 }
 
-using Num = long long;
+#ifdef WORDS_X86
+// Bytes in [lo, hi], bytes >= 0x80 compare as negative and never match
+__m128i in_range_sse2(__m128i v, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1)));
+}
 
-bool isPalindrome(const std::vector<Num>& nums) {
-    auto last = nums.size() - 1;
-    for (size_t i = 0; i < last - i; ++i) {
-        if (nums[i] != nums[last - i]) return false;
+uint64_t word_mask_sse2(const char* p) {
+    uint64_t mask = 0;
+    for (unsigned i = 0; i < 64; i += 16) {
+        auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        auto alpha = in_range_sse2(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+        auto word = _mm_or_si128(_mm_or_si128(alpha, in_range_sse2(v, '0', '9')), _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+        mask |= uint64_t(uint32_t(_mm_movemask_epi8(word))) << i;
     }
-    return true;
+    return mask;
 }
 
-// TODO: Handle '999999999999999999999999999999' better
-bool counts_up_and_down(std::string s)
+DigitMasks digit_masks_sse2(const char* p) {
+    DigitMasks masks;
+    for (unsigned i = 0; i < 64; i += 16) {
+        auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        auto space = _mm_or_si128(in_range_sse2(v, '\t', '\r'), _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+        masks.digit |= uint64_t(uint32_t(_mm_movemask_epi8(in_range_sse2(v, '0', '9')))) << i;
+        masks.space |= uint64_t(uint32_t(_mm_movemask_epi8(space))) << i;
+    }
+    return masks;
+}
+
+WORDS_TARGET("avx2")
+__m256i in_range_avx2(__m256i v, char lo, char hi) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(lo - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), v));
+}
+
+WORDS_TARGET("avx2")
+uint64_t word_mask_avx2(const char* p) {
+    uint64_t mask = 0;
+    for (unsigned i = 0; i < 64; i += 32) {
+        auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        auto alpha = in_range_avx2(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z');
+        auto word = _mm256_or_si256(_mm256_or_si256(alpha, in_range_avx2(v, '0', '9')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+        mask |= uint64_t(uint32_t(_mm256_movemask_epi8(word))) << i;
+    }
+    return mask;
+}
+
+WORDS_TARGET("avx2")
+DigitMasks digit_masks_avx2(const char* p) {
+    DigitMasks masks;
+    for (unsigned i = 0; i < 64; i += 32) {
+        auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        auto space = _mm256_or_si256(in_range_avx2(v, '\t', '\r'), _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+        masks.digit |= uint64_t(uint32_t(_mm256_movemask_epi8(in_range_avx2(v, '0', '9')))) << i;
+        masks.space |= uint64_t(uint32_t(_mm256_movemask_epi8(space))) << i;
+    }
+    return masks;
+}
+
+#ifdef _MSC_VER
+bool has_avx2() {
+    int info[4];
+    __cpuid(info, 1);
+    bool os_avx = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6;
+    __cpuidex(info, 7, 0);
+    return os_avx && (info[1] & (1 << 5));
+}
+#else
+bool has_avx2() { return __builtin_cpu_supports("avx2"); }
+#endif
+#endif
+
+// Byte classifiers for one instruction set
+struct ScanKernel {
+    const char* name;
+    uint64_t (*words)(const char* p);
+    DigitMasks (*digits)(const char* p);
+    bool (*supported)();
+};
+
+// Every classifier set, best first (the scalar one works everywhere)
+static const ScanKernel scan_kernels[] = {
+#ifdef WORDS_X86
+    { "avx2", word_mask_avx2, digit_masks_avx2, has_avx2 },
+    { "sse2", word_mask_sse2, digit_masks_sse2, [] { return true; } },
+#endif
+    { "scalar", word_mask_scalar, digit_masks_scalar, [] { return true; } }
+};
+
+// Get the best classifiers the CPU supports, chosen on first use
+const ScanKernel& scan_kernel() {
+    static const ScanKernel& best = *std::find_if(std::begin(scan_kernels), std::end(scan_kernels),
+                                                  [](const ScanKernel& k) { return k.supported(); });
+    return best;
+}
+
+// Multiply-xorshift hash that reads the word 8 bytes at a time
+uint64_t hash_word(std::string_view word) {
+    constexpr uint64_t k = 0x9E3779B97F4A7C15ull;
+    auto mix = [&](uint64_t h, uint64_t x) {
+        h = (h ^ x) * k;
+        return h ^ (h >> 32);
+    };
+
+    uint64_t h = word.size() * k;
+    size_t i = 0;
+    for (; i + 8 <= word.size(); i += 8) {
+        uint64_t x;
+        std::memcpy(&x, word.data() + i, 8);
+        h = mix(h, x);
+    }
+    if (i != word.size()) {
+        uint64_t x = 0;
+        std::memcpy(&x, word.data() + i, word.size() - i);
+        h = mix(h, x);
+    }
+    return mix(h, 0);
+}
+
+// Bump allocator for word bytes, reset() keeps its blocks for the next run
+class Arena {
+    static constexpr size_t block_size = 1 << 16;
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    std::vector<std::unique_ptr<char[]>> large;     // Words too big to share a block
+    size_t block = 0, used = 0;                     // Block being filled and the bytes used in it
+
+public:
+    // Copy of the (non-empty) bytes that lives until the next reset()
+    const char* copy(std::string_view bytes) {
+        char* out;
+        if (bytes.size() > block_size / 4) {
+            large.emplace_back(new char[bytes.size()]);
+            out = large.back().get();
+        }
+        else {
+            if (blocks.empty() || used + bytes.size() > block_size) {
+                if (!blocks.empty()) ++block;
+                if (block == blocks.size()) blocks.emplace_back(new char[block_size]);
+                used = 0;
+            }
+            out = blocks[block].get() + used;
+            used += bytes.size();
+        }
+        std::memcpy(out, bytes.data(), bytes.size());
+        return out;
+    }
+
+    void reset() {
+        large.clear();
+        block = used = 0;
+    }
+};
+
+// Open-addressing set of words, linear probing over a power-of-two table that is kept at most half full
+    // Words are copied into an arena, so the set never points into the caller's buffers
+class WordSet {
+    struct Slot {
+        const char* data = nullptr;     // nullptr marks an empty slot
+        size_t size = 0;
+        uint64_t hash = 0;
+    };
+
+    std::vector<Slot> slots;
+    size_t count = 0;
+    Arena arena;
+
+    void grow() {
+        std::vector<Slot> old(std::max<size_t>(64, 2 * slots.size()));
+        old.swap(slots);
+        auto mask = slots.size() - 1;
+        for (auto& s : old) {
+            if (!s.data) continue;
+            auto i = s.hash & mask;
+            while (slots[i].data) i = (i + 1) & mask;
+            slots[i] = s;
+        }
+    }
+
+public:
+    // Add a non-empty word, returns false if it was already there
+    bool insert(std::string_view word) {
+        if (2 * (count + 1) > slots.size()) grow();
+
+        auto h = hash_word(word);
+        auto mask = slots.size() - 1;
+        for (auto i = h & mask; ; i = (i + 1) & mask) {
+            auto& s = slots[i];
+            if (!s.data) {
+                s = { arena.copy(word), word.size(), h };
+                ++count;
+                return true;
+            }
+            if (s.hash == h && s.size == word.size() && std::memcmp(s.data, word.data(), word.size()) == 0) return false;
+        }
+    }
+
+    size_t size() const { return count; }
+
+    // Forget every word, the table and arena stay allocated
+    void clear() {
+        std::fill(slots.begin(), slots.end(), Slot{});
+        count = 0;
+        arena.reset();
+    }
+};
+
+// Streaming check that no word appears twice, where a word is a run of [A-Za-z0-9_]
+    // Input can be split into chunks anywhere, a word cut off by the end of a chunk is kept in a carry buffer
+    // Word boundaries come from the classifier's bitmask, one 64-byte block at a time
+class UniqueWords {
+public:
+    static constexpr size_t npos = size_t(-1);
+
+private:
+    const ScanKernel& kernel = scan_kernel();
+    WordSet seen;
+    std::string carry;              // Start of the word still open at the end of the last chunk
+    size_t offset = 0;              // Stream offset of the current chunk
+    size_t carry_offset = 0;        // Stream offset of the carried word
+    size_t duplicate = npos;
+    bool in_word = false;
+
+    bool add(std::string_view word, size_t at) {
+        if (seen.insert(word)) return true;
+        duplicate = at;
+        return false;
+    }
+
+public:
+    // Scan the next chunk, returns false once a repeated word has been found
+    bool feed(std::string_view chunk) {
+        if (duplicate != npos) return false;
+
+        auto p = chunk.data();
+        bool carried = in_word;     // The open word started in an earlier chunk
+        size_t start = 0;           // Otherwise this is where it started
+        for (size_t i = 0; i < chunk.size(); i += 64) {
+            auto n = std::min<size_t>(64, chunk.size() - i);
+            uint64_t mask, valid = ~uint64_t(0);
+            if (n == 64) mask = kernel.words(p + i);
+            else {
+                // Pad the last block with zeros, which aren't word chars, and ignore the edge they make
+                char tail[64] = {};
+                std::memcpy(tail, p + i, n);
+                mask = kernel.words(tail);
+                valid = (uint64_t(1) << n) - 1;
+            }
+
+            // A bit that differs from the one before it is the start or the end of a word
+            auto edges = (mask ^ ((mask << 1) | uint64_t(in_word))) & valid;
+            in_word = (mask >> (n - 1)) & 1;
+
+            for (; edges; edges &= edges - 1) {
+                auto bit = lowest_bit(edges);
+                auto at = i + bit;
+                if ((mask >> bit) & 1) {
+                    start = at;
+                    carried = false;
+                    continue;
+                }
+
+                bool ok;
+                if (carried) {
+                    carry.append(p, at);
+                    ok = add(carry, carry_offset);
+                    carry.clear();
+                }
+                else ok = add({ p + start, at - start }, offset + start);
+                if (!ok) return false;
+            }
+        }
+
+        if (in_word) {
+            if (carried) carry.append(p, chunk.size());
+            else {
+                carry.assign(p + start, chunk.size() - start);
+                carry_offset = offset + start;
+            }
+        }
+        offset += chunk.size();
+        return true;
+    }
+
+    // End the stream, closing the last word, returns whether every word was unique
+    bool finish() {
+        if (in_word && duplicate == npos) add(carry, carry_offset);
+        in_word = false;
+        carry.clear();
+        return duplicate == npos;
+    }
+
+    // Stream offset of the first repeated word, or npos
+    size_t duplicate_offset() const { return duplicate; }
+
+    size_t unique_words() const { return seen.size(); }
+
+    // Start a new stream, keeping the allocated table, arena and carry buffer
+    void reset() {
+        seen.clear();
+        carry.clear();
+        offset = carry_offset = 0;
+        duplicate = npos;
+        in_word = false;
+    }
+};
+
+// Offset of the first word in s that repeats an earlier one, or UniqueWords::npos
+size_t first_duplicate_word(std::string_view s) {
+    UniqueWords words;
+    words.feed(s);
+    words.finish();
+    return words.duplicate_offset();
+}
+
+bool all_words_unique(std::string_view s) {
+    return first_duplicate_word(s) == UniqueWords::npos;
+}
+
+// Same as first_duplicate_word over a whole file, mapped into memory when possible and read in chunks otherwise
+size_t first_duplicate_word_in_file(const std::string& path) {
+    UniqueWords words;
+
+#if defined(__unix__) || defined(__APPLE__)
+    auto fd = open(path.c_str(), O_RDONLY);
+    if (fd != -1) {
+        struct stat st;
+        void* addr = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+
+        if (addr != MAP_FAILED) {
+            madvise(addr, st.st_size, MADV_SEQUENTIAL);
+            words.feed({ static_cast<const char*>(addr), static_cast<size_t>(st.st_size) });
+            munmap(addr, st.st_size);
+            words.finish();
+            return words.duplicate_offset();
+        }
+    }
+#endif
+
+    std::ifstream in{ path, std::ios::binary };
+    if (!in) throw std::runtime_error{ "Can't open " + path };
+
+    std::vector<char> buffer(1 << 20);
+    while (in.read(buffer.data(), buffer.size()) || in.gcount()) {
+        if (!words.feed({ buffer.data(), static_cast<size_t>(in.gcount()) })) break;
+    }
+    words.finish();
+    return words.duplicate_offset();
+}
+
+// Digit and space masks of an input, one 64-byte block at a time, with the last block it classified kept
+    // Bytes past the end read as zeros, which are neither digits nor spaces
+class DigitBlocks {
+    static constexpr size_t none = size_t(-1);
+
+    const ScanKernel& kernel = scan_kernel();
+    std::string_view s;
+    size_t cached = none;
+    DigitMasks masks;
+
+public:
+    explicit DigitBlocks(std::string_view s) : s{ s } {}
+
+    const DigitMasks& block(size_t k) {
+        if (k != cached) {
+            auto at = k * 64;
+            if (at + 64 <= s.size()) masks = kernel.digits(s.data() + at);
+            else {
+                char tail[64] = {};
+                std::memcpy(tail, s.data() + at, s.size() - at);
+                masks = kernel.digits(tail);
+            }
+            cached = k;
+        }
+        return masks;
+    }
+
+    // First index >= pos that isn't a digit (or a space), or the size
+    template <uint64_t DigitMasks::*Class>
+    size_t skip_forward(size_t pos) {
+        while (pos < s.size()) {
+            auto k = pos / 64;
+            auto m = ~(block(k).*Class) & (~uint64_t(0) << (pos % 64));
+            if (m) return std::min(k * 64 + lowest_bit(m), s.size());
+            pos = (k + 1) * 64;
+        }
+        return s.size();
+    }
+
+    // One past the last index < pos that isn't a digit (or a space), or 0
+    template <uint64_t DigitMasks::*Class>
+    size_t skip_backward(size_t pos) {
+        while (pos > 0) {
+            auto k = (pos - 1) / 64;
+            auto used = pos - k * 64;
+            auto m = ~(block(k).*Class) & (used == 64 ? ~uint64_t(0) : (uint64_t(1) << used) - 1);
+            if (m) return k * 64 + highest_bit(m) + 1;
+            pos = k * 64;
+        }
+        return 0;
+    }
+};
+
+// Digits of a number without its leading zeros, so equal numbers have equal spans however long they are
+std::string_view significant(std::string_view digits) {
+    auto first = digits.find_first_not_of('0');
+    return first == std::string_view::npos ? std::string_view{} : digits.substr(first);
+}
+
+// Whether s is a whitespace separated list of numbers that reads the same both ways and starts at 1, like "1 2 3 2 1"
+    // Numbers are read from both ends at once and compared as digit spans, nothing is converted or buffered
+    // Each end classifies its 64-byte blocks once, the middle block may be classified by both
+bool counts_up_and_down(std::string_view s)
 {
-    auto front = std::begin(s);
-    const auto back = std::end(s);
-    
-    std::vector<Num> nums;
-    
-    while (front != back) {
-        auto num_start = std::find_if(front, back, [](auto& c) { return !std::isspace(c); });
-        if (num_start == back) break;
-        
-        front = std::find_if(num_start, back, [](auto& c) { return !std::isdigit(c); });
-        if (front == num_start || std::distance(num_start, front) > 19) return false;
-        
-        nums.push_back(std::stoll(std::string{ num_start, front }));
+    DigitBlocks front_blocks{ s }, back_blocks{ s };
+    size_t front = 0, back = s.size();
+
+    for (bool first = true; ; first = false) {
+        auto front_start = front_blocks.skip_forward<&DigitMasks::space>(front);
+        if (front_start >= back) return false;      // An even count, or nothing at all
+
+        // The number ends at a space or the end of the input, anything else is garbage
+        auto front_end = front_blocks.skip_forward<&DigitMasks::digit>(front_start);
+        if (front_end == front_start || (front_end != s.size() && !isSpaceChar(s[front_end]))) return false;
+
+        auto back_end = back_blocks.skip_backward<&DigitMasks::space>(back);
+        auto back_start = back_blocks.skip_backward<&DigitMasks::digit>(back_end);
+        if (back_start == back_end || (back_start != 0 && !isSpaceChar(s[back_start - 1]))) return false;
+
+        auto number = significant(s.substr(front_start, front_end - front_start));
+        if (first && number != "1") return false;
+        if (front_start == back_start) return true;     // Both ends reached the middle number
+        if (number != significant(s.substr(back_start, back_end - back_start))) return false;
+
+        front = front_end;
+        back = back_start;
+    }
+}
+
+// Throughput of counts_up_and_down over generated sequences, with short and with 100-digit numbers
+void benchmark_counts_up_and_down() {
+    auto sequence = [](size_t n, size_t pad) {
+        std::string s;
+        auto add = [&](size_t i) {
+            auto digits = std::to_string(i);
+            s.append(pad > digits.size() ? pad - digits.size() : 0, '0');
+            s += digits;
+            s += ' ';
+        };
+        for (size_t i = 1; i <= n; ++i) add(i);
+        for (size_t i = n - 1; i >= 1; --i) add(i);
+        return s;
+    };
+
+    for (auto pad : { size_t(0), size_t(100) }) {
+        auto s = sequence(pad ? 250000 : 5000000, pad);
+        bool ok = true;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < 5; ++i) ok &= counts_up_and_down(s);
+        std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+
+        std::cout << (pad ? "100-digit" : "short") << " numbers: " << 5 * s.size() / took.count() / 1e6 << " MB/s"
+                  << (ok ? "\n" : " (wrong answer)\n");
     }
-    
-    return nums.size() % 2 && isPalindrome(nums) && nums.front() == 1;
 }
 
 
 // Print '1..n..1' without repeating a word
-int main() {
-    std::cout << "1\n";
+int main(int argc, char** argv) {
+    // Offset of the first duplicate when s is fed n bytes at a time
+    auto fed_in_chunks = [](std::string_view s, size_t n) {
+        UniqueWords words;
+        for (size_t i = 0; i < s.size(); i += n) words.feed(s.substr(i, n));
+        words.finish();
+        return words.duplicate_offset();
+    };
+
+    assert(first_duplicate_word("alpha beta gamma beta") == 17);
+    assert(all_words_unique("alpha beta, gamma-delta 1 2 3 beta_") && first_duplicate_word("") == UniqueWords::npos);
+    assert(fed_in_chunks("one two three four three", 11) == 19);    // Both "three"s are cut by a chunk end
+
+    std::string long_word(100, 'x'), text = long_word + " " + std::string(150, 'a') + " " + long_word + "y " + long_word;
+    assert(first_duplicate_word(text) == 354 && all_words_unique(text.substr(0, 353)));
+    for (size_t n : { 1, 7, 32, 64, 100 }) {
+        assert(fed_in_chunks(text, n) == 354);
+        assert(fed_in_chunks(text.substr(0, 353), n) == UniqueWords::npos);
+    }
+
+    // Numbers are compared as digit spans, so they can be any length and leading zeros don't count
+    std::string big(25, '9');
+    assert(counts_up_and_down("1 2 " + big + " 2 1") && !counts_up_and_down("1 " + big + " 8" + big + " 1"));
+    assert(counts_up_and_down("1 02 1") && counts_up_and_down("1 2 1") && counts_up_and_down("01 2 3 002 1"));
+    assert(!counts_up_and_down("1 2 2 1") && !counts_up_and_down("2 3 2") && !counts_up_and_down("1 2 3 1"));
+
+    if (argc > 1 && std::string_view{ argv[1] } == "--benchmark") benchmark_counts_up_and_down();
+    else std::cout << "1\n";
 }
\ No newline at end of file
@@ -1,189 +1,1685 @@
 #include "catch.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <limits>
 #include <memory>
+#include <mutex>
 #include <numeric>
+#include <optional>
+#include <random>
 #include <set>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _MSC_VER
+#define NOINLINE __declspec(noinline)
+#else
+#define NOINLINE __attribute__((noinline))
+#endif
+
 // This class helps track instances for testing purposes
 struct DebugNodeTracker {
     DebugNodeTracker();
+    DebugNodeTracker(DebugNodeTracker const&);
     ~DebugNodeTracker();
     auto getSlotCount() const -> size_t;
 };
 
 
-struct Node;
-using NodePtr = std::shared_ptr<Node>;
+// Nodes refer to each other by 32-bit index into their pool
+using NodeId = uint32_t;
+constexpr NodeId noNode = std::numeric_limits<NodeId>::max();
+
+// Slot of a key's value in a map trie (a set has none)
+constexpr uint32_t noValue = std::numeric_limits<uint32_t>::max();
+
+// Child layouts, picked by fan-out like the nodes of an adaptive radix tree
+enum class NodeKind : uint8_t { Node4, Node16, Node48, Node256 };
+
+// Up to 4 (or 16) children, kept in key order
+struct Node4 {
+    uint8_t keys[4];
+    NodeId children[4];
+};
+
+// Searched with a single vector compare of all 16 keys
+struct Node16 {
+    alignas(16) uint8_t keys[16];
+    NodeId children[16];
+};
+
+// Up to 48 children, `index` maps a key to its slot + 1 (0 when there is no child)
+struct Node48 {
+    uint8_t index[256];
+    NodeId children[48];
+};
+
+// A slot for every key
+struct Node256 {
+    NodeId children[256];
+};
+
+// A node stands for the string of its parent + the key of its slot in the parent + its label
+    // The label is a slice of the pool's byte arena, the children live in a block of the pool's arena for their kind
+struct Node {
+    uint32_t label = 0;             // Offset of the label in the byte arena
+    uint32_t length = 0;            // Length of the label
+    uint32_t block = noNode;        // Child block (noNode while the node has no children)
+    uint32_t keys = 0;              // Number of keys in the node's subtree (including its own)
+    uint16_t count = 0;             // Number of children
+    NodeKind kind = NodeKind::Node4;
+    bool terminal = false;          // Whether a key ends at this node
+    uint32_t value = noValue;       // Slot of the value of the key ending here, in a map
+};
+
+// Vector whose elements never move once added, so a reader can keep using them while a writer appends
+    // Elements live in chunks of about 16KB, found through a directory that is replaced (not modified) when it fills up
+    // Readers may only use indices that were published to them after the elements were written
+template <class T>
+class StableVector {
+    static constexpr auto chunkBits = [] {
+        unsigned bits = 0;
+        while ((size_t(2) << bits) * sizeof(T) <= 16384) ++bits;
+        return bits;
+    }();
+    static constexpr size_t chunkSize = size_t(1) << chunkBits;
+    static constexpr size_t chunkMask = chunkSize - 1;
+
+    std::atomic<T**> m_dir{ nullptr };
+    size_t m_slots = 0;                                 // Chunk slots in the current directory
+    size_t m_filled = 0;                                // Chunk slots that point at a chunk
+    size_t m_size = 0;
+    std::vector<std::unique_ptr<T*[]>> m_dirs;          // Replaced directories stay alive for readers that still hold them
+    std::vector<std::unique_ptr<T[]>> m_chunks;
+    size_t m_bytes = 0;                                 // Bytes held by chunks and directories
+
+    public:
+        StableVector() = default;
+        StableVector(StableVector&& other) noexcept { *this = std::move(other); }
+
+        auto operator=(StableVector&& other) noexcept -> StableVector& {
+            m_dir.store(other.m_dir.exchange(nullptr));
+            m_slots = std::exchange(other.m_slots, 0);
+            m_filled = std::exchange(other.m_filled, 0);
+            m_size = std::exchange(other.m_size, 0);
+            m_dirs = std::move(other.m_dirs);
+            m_chunks = std::move(other.m_chunks);
+            m_bytes = std::exchange(other.m_bytes, 0);
+            return *this;
+        }
+
+        auto operator[](size_t idx) -> T& { return m_dir.load(std::memory_order_acquire)[idx >> chunkBits][idx & chunkMask]; }
+        auto operator[](size_t idx) const -> T const& { return m_dir.load(std::memory_order_acquire)[idx >> chunkBits][idx & chunkMask]; }
+
+        // Pointer to the element, the `n` elements of a single `append(n)` are contiguous
+        auto data(size_t idx) -> T* { return &(*this)[idx]; }
+        auto data(size_t idx) const -> T const* { return &(*this)[idx]; }
+
+        auto size() const { return m_size; }
+
+        // Add `n` value-initialized elements that sit next to each other, returning the index of the first
+            // A run that doesn't fit the current chunk starts the next one, a run longer than a chunk gets one allocation over several slots
+        auto append(size_t n = 1) -> size_t {
+            auto start = m_size;
+            if ((start & chunkMask) && n > chunkSize - (start & chunkMask)) start = (start + chunkMask) & ~chunkMask;
+
+            auto end = start + n;
+            auto needed = (end + chunkMask) >> chunkBits;
+            if (needed > m_filled) {
+                auto count = needed - m_filled;
+                auto& chunk = m_chunks.emplace_back(std::make_unique<T[]>(count * chunkSize));
+                m_bytes += count * chunkSize * sizeof(T);
+
+                auto dir = m_dir.load(std::memory_order_relaxed);
+                if (needed > m_slots) {
+                    m_slots = std::max<size_t>(16, needed * 2);
+                    auto& grown = m_dirs.emplace_back(std::make_unique<T*[]>(m_slots));
+                    m_bytes += m_slots * sizeof(T*);
+                    std::copy(dir, dir + m_filled, grown.get());
+                    dir = grown.get();
+                }
+
+                for (size_t i{}; i != count; ++i) dir[m_filled + i] = chunk.get() + i * chunkSize;
+                m_filled = needed;
+                m_dir.store(dir, std::memory_order_release);
+            }
+
+            m_size = end;
+            return start;
+        }
 
-std::string safeSubStr(std::string const& s, size_t idx) {
-    return idx < s.size() ? s.substr(idx) : "";
+        auto bytesUsed() const { return m_bytes; }
+};
+
+// Blocks of one child layout, released blocks are reused before the arena grows
+template <class Block>
+struct BlockArena {
+    StableVector<Block> m_blocks;
+    std::vector<uint32_t> m_free;
+
+    auto alloc() -> uint32_t {
+        uint32_t idx;
+        if (!m_free.empty()) {
+            idx = m_free.back();
+            m_free.pop_back();
+        } else {
+            idx = static_cast<uint32_t>(m_blocks.append());
+        }
+
+        // Only the layouts that are looked up by key need to start out empty
+        if constexpr (std::is_same_v<Block, Node48>) std::fill(std::begin(m_blocks[idx].index), std::end(m_blocks[idx].index), 0);
+        if constexpr (std::is_same_v<Block, Node256>) std::fill(std::begin(m_blocks[idx].children), std::end(m_blocks[idx].children), noNode);
+        return idx;
+    }
+
+    void release(uint32_t idx) { m_free.push_back(idx); }
+
+    auto operator[](uint32_t idx) -> Block& { return m_blocks[idx]; }
+    auto operator[](uint32_t idx) const -> Block const& { return m_blocks[idx]; }
+
+    auto bytesUsed() const -> size_t { return m_blocks.bytesUsed() + m_free.capacity() * sizeof(uint32_t); }
+};
+
+// Index of the lowest set bit
+inline auto lowestBit(unsigned mask) -> unsigned {
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanForward(&idx, mask);
+    return idx;
+#else
+    return __builtin_ctz(mask);
+#endif
 }
 
-struct Node : DebugNodeTracker {
-    std::vector<NodePtr> m_children;
-    std::vector<char> keys;
-    std::string m_value, common;
-    
-    auto findTrie(char c) const {
-        int i = 0;
-        for (auto k : keys) {
-            if (c == k) return i;
-            ++i;
+inline auto lowestBit(uint64_t mask) -> unsigned {
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanForward64(&idx, mask);
+    return idx;
+#else
+    return __builtin_ctzll(mask);
+#endif
+}
+
+inline auto popCount(uint64_t word) -> unsigned {
+#ifdef _MSC_VER
+    return static_cast<unsigned>(__popcnt64(word));
+#else
+    return static_cast<unsigned>(__builtin_popcountll(word));
+#endif
+}
+
+// Owns every node, child block and label of a trie, so a node costs no allocation of its own
+    // Nothing in the pool ever moves, so readers can walk it while a copy-on-write writer adds to it
+struct NodePool : DebugNodeTracker {
+    StableVector<Node> m_nodes;
+    std::vector<NodeId> m_freeNodes;
+    StableVector<char> m_bytes;
+
+    BlockArena<Node4> m_node4;
+    BlockArena<Node16> m_node16;
+    BlockArena<Node48> m_node48;
+    BlockArena<Node256> m_node256;
+
+    NodePool() { m_nodes.append(); }
+
+    auto label(NodeId id) const -> std::string_view {
+        auto& node = m_nodes[id];
+        if (!node.length) return {};
+        return { m_bytes.data(node.label), node.length };
+    }
+
+    auto findChild(NodeId id, char c) const -> NodeId {
+        auto& node = m_nodes[id];
+        auto key = static_cast<uint8_t>(c);
+        if (!node.count) return noNode;
+
+        switch (node.kind) {
+            case NodeKind::Node4: {
+                auto& b = m_node4[node.block];
+                for (int i = 0; i != node.count; ++i)
+                    if (b.keys[i] == key) return b.children[i];
+                return noNode;
+            }
+            case NodeKind::Node16: {
+                auto& b = m_node16[node.block];
+#ifdef __SSE2__
+                auto hits = _mm_cmpeq_epi8(_mm_load_si128(reinterpret_cast<__m128i const*>(b.keys)), _mm_set1_epi8(c));
+                auto mask = static_cast<unsigned>(_mm_movemask_epi8(hits)) & ((1u << node.count) - 1);
+                return mask ? b.children[lowestBit(mask)] : noNode;
+#else
+                for (int i = 0; i != node.count; ++i)
+                    if (b.keys[i] == key) return b.children[i];
+                return noNode;
+#endif
+            }
+            case NodeKind::Node48: {
+                auto slot = m_node48[node.block].index[key];
+                return slot ? m_node48[node.block].children[slot - 1] : noNode;
+            }
+            case NodeKind::Node256:
+                return m_node256[node.block].children[key];
         }
-        return -1;
+        return noNode;
     }
 
-    auto maxSubStrLen(std::string str) {
-        int i = 0;
-        auto maxlen = std::max(str.size(), common.size());
-        while (i < maxlen && str[i] == common[i]) ++i;
-        return i;
+    // Call `fn(key, child)` for every child in key order
+    template <class Fn>
+    void forEachChild(NodeId id, Fn&& fn) const {
+        auto& node = m_nodes[id];
+        if (!node.count) return;
+
+        switch (node.kind) {
+            case NodeKind::Node4:
+                for (int i = 0; i != node.count; ++i) fn(m_node4[node.block].keys[i], m_node4[node.block].children[i]);
+                break;
+            case NodeKind::Node16:
+                for (int i = 0; i != node.count; ++i) fn(m_node16[node.block].keys[i], m_node16[node.block].children[i]);
+                break;
+            case NodeKind::Node48:
+                for (int k = 0; k != 256; ++k)
+                    if (auto slot = m_node48[node.block].index[k]) fn(static_cast<uint8_t>(k), m_node48[node.block].children[slot - 1]);
+                break;
+            case NodeKind::Node256:
+                for (int k = 0; k != 256; ++k)
+                    if (auto child = m_node256[node.block].children[k]; child != noNode) fn(static_cast<uint8_t>(k), child);
+                break;
+        }
     }
 
-    auto getAt(char c) const -> NodePtr {
-        auto index = findTrie(c);
-        return (index != -1) ? m_children[index] : nullptr;
+    // Get the child with the smallest key above `after` (-1 for the first child), noNode when there is none
+    auto nextChild(NodeId id, int after) const -> std::pair<int, NodeId> {
+        auto& node = m_nodes[id];
+        if (!node.count) return { 256, noNode };
+
+        switch (node.kind) {
+            case NodeKind::Node4: {
+                auto& b = m_node4[node.block];
+                for (int i = 0; i != node.count; ++i)
+                    if (b.keys[i] > after) return { b.keys[i], b.children[i] };
+                break;
+            }
+            case NodeKind::Node16: {
+                auto& b = m_node16[node.block];
+                for (int i = 0; i != node.count; ++i)
+                    if (b.keys[i] > after) return { b.keys[i], b.children[i] };
+                break;
+            }
+            case NodeKind::Node48: {
+                auto& b = m_node48[node.block];
+                for (int k = after + 1; k < 256; ++k)
+                    if (b.index[k]) return { k, b.children[b.index[k] - 1] };
+                break;
+            }
+            case NodeKind::Node256: {
+                auto& b = m_node256[node.block];
+                for (int k = after + 1; k < 256; ++k)
+                    if (b.children[k] != noNode) return { k, b.children[k] };
+                break;
+            }
+        }
+        return { 256, noNode };
     }
 
-    auto getNext(std::string str) -> std::tuple<Node*, std::string> {
-        auto len = maxSubStrLen(str);
-        if (len == str.size()) return { this, "" };
+    // Move the node's children into a block of the given kind
+    void convert(NodeId id, NodeKind kind) {
+        NodeId children[256];
+        uint8_t keys[256];
+        int n = 0;
+        forEachChild(id, [&](uint8_t key, NodeId child) {
+            keys[n] = key;
+            children[n++] = child;
+        });
 
-        auto index = findTrie(str[len]);
-        if (index == -1) return { nullptr, "" };
-        return { m_children[index].get(), safeSubStr(str, len + 1) };
+        auto& node = m_nodes[id];
+        releaseBlock(node);
+
+        node.kind = kind;
+        switch (kind) {
+            case NodeKind::Node4: {
+                auto& b = m_node4[node.block = m_node4.alloc()];
+                std::copy(keys, keys + n, b.keys);
+                std::copy(children, children + n, b.children);
+                break;
+            }
+            case NodeKind::Node16: {
+                auto& b = m_node16[node.block = m_node16.alloc()];
+                std::copy(keys, keys + n, b.keys);
+                std::copy(children, children + n, b.children);
+                break;
+            }
+            case NodeKind::Node48: {
+                auto& b = m_node48[node.block = m_node48.alloc()];
+                for (int i = 0; i != n; ++i) {
+                    b.index[keys[i]] = static_cast<uint8_t>(i + 1);
+                    b.children[i] = children[i];
+                }
+                break;
+            }
+            case NodeKind::Node256: {
+                auto& b = m_node256[node.block = m_node256.alloc()];
+                for (int i = 0; i != n; ++i) b.children[keys[i]] = children[i];
+                break;
+            }
+        }
     }
 
-    void setAt(char c, NodePtr const& newChild) {
-        if (auto index = findTrie(c); index == -1) {
-            keys.push_back(c);
-            m_children.push_back(newChild);
-        } else {
-            m_children[index] = newChild;
+    void releaseBlock(Node& node) {
+        if (node.block == noNode) return;
+
+        switch (node.kind) {
+            case NodeKind::Node4: m_node4.release(node.block); break;
+            case NodeKind::Node16: m_node16.release(node.block); break;
+            case NodeKind::Node48: m_node48.release(node.block); break;
+            case NodeKind::Node256: m_node256.release(node.block); break;
         }
+        node.block = noNode;
+    }
+
+    // Insert or remove a key in a sorted key array, shifting the children with it
+    template <class Block>
+    static void insertSorted(Block& b, int count, uint8_t key, NodeId child) {
+        auto pos = static_cast<int>(std::upper_bound(b.keys, b.keys + count, key) - b.keys);
+        std::copy_backward(b.keys + pos, b.keys + count, b.keys + count + 1);
+        std::copy_backward(b.children + pos, b.children + count, b.children + count + 1);
+        b.keys[pos] = key;
+        b.children[pos] = child;
+    }
+
+    template <class Block>
+    static void eraseSorted(Block& b, int count, uint8_t key) {
+        auto pos = static_cast<int>(std::find(b.keys, b.keys + count, key) - b.keys);
+        std::copy(b.keys + pos + 1, b.keys + count, b.keys + pos);
+        std::copy(b.children + pos + 1, b.children + count, b.children + pos);
+    }
+
+    // Add a child under a key the node doesn't have yet, growing the node when its layout is full
+    void linkChild(NodeId id, char c, NodeId child) {
+        auto key = static_cast<uint8_t>(c);
+        auto& node = m_nodes[id];
+
+        if (node.block == noNode) {
+            node.kind = NodeKind::Node4;
+            node.block = m_node4.alloc();
+        } else if (node.kind == NodeKind::Node4 && node.count == 4) {
+            convert(id, NodeKind::Node16);
+        } else if (node.kind == NodeKind::Node16 && node.count == 16) {
+            convert(id, NodeKind::Node48);
+        } else if (node.kind == NodeKind::Node48 && node.count == 48) {
+            convert(id, NodeKind::Node256);
+        }
+
+        switch (node.kind) {
+            case NodeKind::Node4: insertSorted(m_node4[node.block], node.count, key, child); break;
+            case NodeKind::Node16: insertSorted(m_node16[node.block], node.count, key, child); break;
+            case NodeKind::Node48: {
+                auto& b = m_node48[node.block];
+                b.index[key] = static_cast<uint8_t>(node.count + 1);
+                b.children[node.count] = child;
+                break;
+            }
+            case NodeKind::Node256: m_node256[node.block].children[key] = child; break;
+        }
+        ++node.count;
+    }
+
+    // Remove the child under the key, shrinking the node once it fits a smaller layout
+        // Shrinking waits until the node is well below the smaller layout's size, so alternating inserts and erases don't convert every time
+    void unlinkChild(NodeId id, char c) {
+        auto key = static_cast<uint8_t>(c);
+        auto& node = m_nodes[id];
+
+        switch (node.kind) {
+            case NodeKind::Node4: eraseSorted(m_node4[node.block], node.count, key); break;
+            case NodeKind::Node16: eraseSorted(m_node16[node.block], node.count, key); break;
+            case NodeKind::Node48: {
+                // Keep the slots dense by moving the last one into the freed slot
+                auto& b = m_node48[node.block];
+                auto slot = b.index[key] - 1, last = node.count - 1;
+                b.index[key] = 0;
+                if (slot != last) {
+                    b.children[slot] = b.children[last];
+                    *std::find(std::begin(b.index), std::end(b.index), last + 1) = static_cast<uint8_t>(slot + 1);
+                }
+                break;
+            }
+            case NodeKind::Node256: m_node256[node.block].children[key] = noNode; break;
+        }
+        --node.count;
+
+        if (!node.count) releaseBlock(node);
+        else if (node.kind == NodeKind::Node256 && node.count <= 37) convert(id, NodeKind::Node48);
+        else if (node.kind == NodeKind::Node48 && node.count <= 12) convert(id, NodeKind::Node16);
+        else if (node.kind == NodeKind::Node16 && node.count <= 3) convert(id, NodeKind::Node4);
     }
 
-    // I don't think it's splitting right
-    auto splitWith(std::string str) {
-        // Determine how the splitting will happen
-        auto len = maxSubStrLen(str);
+    // Copy the string to the end of the arena and make it the node's label
+    void assign(NodeId id, std::string_view str) {
+        auto at = str.empty() ? 0 : m_bytes.append(str.size());
+        if (!str.empty()) std::copy(str.begin(), str.end(), m_bytes.data(at));
 
-        // If the split occurs earlier than we have room for
-            // Split off the subtries to the next level
-        if (len < common.size()) {
-            auto left = std::make_shared<Node>();
-            m_children.swap(left->m_children);
-            keys.swap(left->keys);
+        m_nodes[id].label = static_cast<uint32_t>(at);
+        m_nodes[id].length = static_cast<uint32_t>(str.size());
+    }
+
+    auto newNode() -> NodeId {
+        if (m_freeNodes.empty()) return static_cast<NodeId>(m_nodes.append());
+
+        auto id = m_freeNodes.back();
+        m_freeNodes.pop_back();
+        m_nodes[id] = Node{};
+        return id;
+    }
 
-            keys.push_back(common[len]);
-            m_children.push_back(left);
-            
-            left->common = safeSubStr(common, len + 1);
-            common = common.substr(0, len);
-            
-            if (m_value != "") {
-                m_value.swap(left->m_value);
+    // Return a childless node to the pool (its label bytes stay in the arena)
+    void releaseNode(NodeId id) {
+        releaseBlock(m_nodes[id]);
+        m_freeNodes.push_back(id);
+    }
+
+    // Add a node and link it under the parent
+    auto addChild(NodeId parent, char key, std::string_view str, bool terminal) -> NodeId {
+        auto id = newNode();
+        m_nodes[id].terminal = terminal;
+        m_nodes[id].keys = terminal;
+
+        assign(id, str);
+        linkChild(parent, key, id);
+        return id;
+    }
+
+    // Cut the node's label after `len` characters, moving the rest (with its children) into a new child
+        // Both halves stay where they were in the arena, the character at `len` becomes the new child's key
+    void split(NodeId id, size_t len) {
+        auto rest = newNode();
+        auto& tail = m_nodes[rest];
+        auto& node = m_nodes[id];
+
+        tail.label = node.label + static_cast<uint32_t>(len) + 1;
+        tail.length = node.length - static_cast<uint32_t>(len) - 1;
+        tail.block = node.block;
+        tail.count = node.count;
+        tail.kind = node.kind;
+        tail.keys = node.keys;
+        tail.terminal = node.terminal;
+        tail.value = node.value;
+
+        auto key = m_bytes[node.label + len];
+        node.length = static_cast<uint32_t>(len);
+        node.block = noNode;
+        node.count = 0;
+        node.terminal = false;
+        node.value = noValue;
+        linkChild(id, key, rest);
+    }
+
+    // Copy the node (and its child block) into a new node that isn't visible to anyone yet
+    auto clone(NodeId id) -> NodeId {
+        auto copy = newNode();
+        auto& node = m_nodes[copy];
+        node = m_nodes[id];
+        if (node.block == noNode) return copy;
+
+        switch (node.kind) {
+            case NodeKind::Node4: node.block = m_node4.alloc(); m_node4[node.block] = m_node4[m_nodes[id].block]; break;
+            case NodeKind::Node16: node.block = m_node16.alloc(); m_node16[node.block] = m_node16[m_nodes[id].block]; break;
+            case NodeKind::Node48: node.block = m_node48.alloc(); m_node48[node.block] = m_node48[m_nodes[id].block]; break;
+            case NodeKind::Node256: node.block = m_node256.alloc(); m_node256[node.block] = m_node256[m_nodes[id].block]; break;
+        }
+        return copy;
+    }
+
+    // Point the node's existing slot for the key at another child
+    void replaceChild(NodeId id, char c, NodeId child) {
+        auto key = static_cast<uint8_t>(c);
+        auto& node = m_nodes[id];
+
+        switch (node.kind) {
+            case NodeKind::Node4: {
+                auto& b = m_node4[node.block];
+                *std::find(b.children, b.children + node.count, findChild(id, c)) = child;
+                break;
+            }
+            case NodeKind::Node16: {
+                auto& b = m_node16[node.block];
+                b.children[std::find(b.keys, b.keys + node.count, key) - b.keys] = child;
+                break;
             }
+            case NodeKind::Node48: m_node48[node.block].children[m_node48[node.block].index[key] - 1] = child; break;
+            case NodeKind::Node256: m_node256[node.block].children[key] = child; break;
         }
+    }
+
+    // Nodes replaced by copies while a copy-on-write writer walked down (null when writing in place)
+    using Replaced = std::vector<NodeId>;
+
+    // Get the child a writer may change: the child itself, or a copy linked in its place when writing copy-on-write
+        // The parent must already be writable
+    auto writableChild(NodeId parent, char key, NodeId child, Replaced* replaced) -> NodeId {
+        if (!replaced) return child;
+
+        auto copy = clone(child);
+        replaceChild(parent, key, copy);
+        replaced->push_back(child);
+        return copy;
+    }
+
+    // Length of the common prefix of the two strings
+    static auto commonPrefix(std::string_view a, std::string_view b) -> size_t {
+        auto len = std::min(a.size(), b.size());
+        return std::mismatch(a.begin(), a.begin() + len, b.begin()).first - a.begin();
+    }
+
+    // Get the node where the string ends as a key, noNode when it isn't one
+    auto findKey(NodeId id, std::string_view str) const -> NodeId {
+        while (true) {
+            auto label = this->label(id);
+            if (str.substr(0, label.size()) != label) return noNode;
+
+            str.remove_prefix(label.size());
+            if (str.empty()) return m_nodes[id].terminal ? id : noNode;
 
-        // Handle the new string being smaller than the old
-        if (len == str.size()) {
-            m_value = str;
+            id = findChild(id, str[0]);
+            if (id == noNode) return noNode;
+            str.remove_prefix(1);
+        }
+    }
+
+    auto contains(NodeId id, std::string_view str) const -> bool { return findKey(id, str) != noNode; }
+
+    // Add `delta` to the key count of every node on the string's path
+    void countAlong(NodeId id, std::string_view str, int delta) {
+        while (id != noNode) {
+            m_nodes[id].keys += delta;
+
+            str.remove_prefix(std::min(str.size(), size_t{ m_nodes[id].length }));
+            if (str.empty()) return;
+
+            id = findChild(id, str[0]);
+            str.remove_prefix(1);
+        }
+    }
+
+    // Insert the string below the (writable) node, returning the node it ends at and false when it was already there
+        // Every node on the way counts the new key as it is passed, which is undone for a duplicate
+    auto insertBelow(NodeId id, std::string_view str, Replaced* replaced) -> std::pair<NodeId, bool> {
+        // The first key goes straight into an empty root
+        if (!m_nodes[id].terminal && !m_nodes[id].count && !m_nodes[id].length) {
+            assign(id, str);
+            m_nodes[id].terminal = true;
+            m_nodes[id].keys = 1;
+            return { id, true };
+        }
+
+        auto root = id;
+        auto key = str;
+        while (true) {
+            auto label = this->label(id);
+            auto len = commonPrefix(label, str);
+
+            // The string leaves (or ends) inside the label, so the label has to be split there
+            if (len < label.size()) {
+                split(id, len);
+                ++m_nodes[id].keys;
+                if (len < str.size()) return { addChild(id, str[len], str.substr(len + 1), true), true };
+
+                m_nodes[id].terminal = true;
+                return { id, true };
+            }
+
+            ++m_nodes[id].keys;
+            str.remove_prefix(len);
+            if (str.empty()) {
+                if (m_nodes[id].terminal) {
+                    countAlong(root, key, -1);
+                    return { id, false };
+                }
+                m_nodes[id].terminal = true;
+                return { id, true };
+            }
+
+            auto next = findChild(id, str[0]);
+            if (next == noNode) return { addChild(id, str[0], str.substr(1), true), true };
+
+            id = writableChild(id, str[0], next, replaced);
+            str.remove_prefix(1);
+        }
+    }
+
+    // What an erase found: whether the key was there, and the slot of its value in a map
+    struct Erased {
+        bool found = false;
+        uint32_t value = noValue;
+    };
+
+    // Merge the node's only child into it, joining the labels around the child's key, so paths stay compressed
+        // The node must be writable, the child is replaced by a copy first when writing copy-on-write
+    void absorbChild(NodeId id, Replaced* replaced) {
+        auto [key, only] = nextChild(id, -1);
+        auto child = writableChild(id, static_cast<char>(key), only, replaced);
+        auto head = label(id), tail = label(child);
+
+        auto& node = m_nodes[id];
+        auto& from = m_nodes[child];
+        auto at = m_bytes.append(head.size() + 1 + tail.size());
+        auto out = std::copy(head.begin(), head.end(), m_bytes.data(at));
+        *out++ = static_cast<char>(key);
+        std::copy(tail.begin(), tail.end(), out);
+
+        // The node takes over the child's children (and key), its own block only held the child
+        releaseBlock(node);
+        node.label = static_cast<uint32_t>(at);
+        node.length = static_cast<uint32_t>(head.size() + 1 + tail.size());
+        node.block = std::exchange(from.block, noNode);
+        node.count = std::exchange(from.count, uint16_t{ 0 });
+        node.kind = from.kind;
+        node.terminal = from.terminal;
+        node.value = from.value;
+        releaseNode(child);
+    }
+
+    // Erase the string below the (writable) node, recording in `erased` whether it was there
+        // Returns whether the node is left without keys or children, emptied children go back to the pool
+        // A node left with neither a key nor a branch is merged with its only child
+    auto eraseBelow(NodeId id, std::string_view str, Erased& erased, Replaced* replaced) -> bool {
+        auto label = this->label(id);
+        if (str.substr(0, label.size()) != label) return false;
+        str.remove_prefix(label.size());
+
+        if (str.empty()) {
+            if (!m_nodes[id].terminal) return false;
+            m_nodes[id].terminal = false;
+            erased.found = true;
+            erased.value = std::exchange(m_nodes[id].value, noValue);
+        } else {
+            auto child = findChild(id, str[0]);
+            if (child == noNode) return false;
+
+            child = writableChild(id, str[0], child, replaced);
+            if (eraseBelow(child, str.substr(1), erased, replaced)) {
+                unlinkChild(id, str[0]);
+                releaseNode(child);
+            }
+        }
+
+        m_nodes[id].keys -= erased.found;
+        if (erased.found && !m_nodes[id].terminal && m_nodes[id].count == 1) absorbChild(id, replaced);
+
+        return !m_nodes[id].terminal && !m_nodes[id].count;
+    }
+
+    // How a bulk build gets its space: counting what it would use (to reserve it up front for threads that
+        // then write into their own reserved space), or appending to the arenas node by node on a single thread
+    enum class BuildMode { Count, Write, Append };
+
+    // Where a bulk build puts its next node, label bytes and child block of each kind
+    struct BuildCursor {
+        BuildMode mode = BuildMode::Count;
+        size_t nodes = 0;
+        size_t bytes = 0;
+        size_t blocks[4] = {};
+    };
+
+    // Smallest layout that holds the children
+    static auto kindFor(size_t count) -> NodeKind {
+        if (count <= 4) return NodeKind::Node4;
+        if (count <= 16) return NodeKind::Node16;
+        if (count <= 48) return NodeKind::Node48;
+        return NodeKind::Node256;
+    }
+
+    // Call `fn(key, first, last)` for each run of keys that agree on the character at `at`, in order
+        // The end of a run is found by galloping, so the many short runs deep in the trie cost a few compares each
+    template <class Fn>
+    static void forEachRun(std::string_view const* first, std::string_view const* last, size_t at, Fn&& fn) {
+        while (first != last) {
+            auto key = static_cast<uint8_t>((*first)[at]);
+            auto size = static_cast<size_t>(last - first);
+            size_t bound = 1;
+            while (bound < size && static_cast<uint8_t>(first[bound][at]) == key) bound *= 2;
+
+            auto end = std::upper_bound(first + bound / 2, first + std::min(bound, size), key,
+                                        [at](uint8_t k, std::string_view str) { return k < static_cast<uint8_t>(str[at]); });
+            fn(key, first, end);
+            first = end;
+        }
+    }
+
+    // Lay out the node for sorted, distinct keys that agree on their first `depth` characters, with its label and child block
+        // The children get consecutive ids from the cursor, returns where their keys are in the strings and the first child's id
+    auto layout(NodeId id, std::string_view const* keys, size_t n, size_t depth, BuildCursor& at) -> std::pair<size_t, NodeId> {
+        auto first = keys[0].substr(depth);
+        auto len = commonPrefix(first, keys[n - 1].substr(depth));
+        bool terminal = first.size() == len;
+
+        size_t count = 0;
+        forEachRun(keys + terminal, keys + n, depth + len, [&](uint8_t, auto, auto) { ++count; });
+
+        auto kind = kindFor(count);
+        if (at.mode == BuildMode::Append) {
+            BuildCursor need;
+            need.nodes = count;
+            need.bytes = len;
+            need.blocks[static_cast<int>(kind)] = count != 0;
+            at = reserve(need, BuildMode::Append);
+        }
+
+        auto block = count ? static_cast<uint32_t>(at.blocks[static_cast<int>(kind)]++) : noNode;
+        auto children = static_cast<NodeId>(at.nodes);
+        auto label = len ? static_cast<uint32_t>(at.bytes) : 0;
+        at.nodes += count;
+        at.bytes += len;
+        if (at.mode == BuildMode::Count) return { depth + len, children };
+
+        if (len) std::copy(first.begin(), first.begin() + len, m_bytes.data(label));
+        m_nodes[id] = Node{ label, static_cast<uint32_t>(len), block, static_cast<uint32_t>(n), static_cast<uint16_t>(count), kind, terminal };
+        if (!count) return { depth + len, children };
+
+        int slot = 0;
+        if (kind == NodeKind::Node48) std::fill(std::begin(m_node48[block].index), std::end(m_node48[block].index), 0);
+        if (kind == NodeKind::Node256) std::fill(std::begin(m_node256[block].children), std::end(m_node256[block].children), noNode);
+        forEachRun(keys + terminal, keys + n, depth + len, [&](uint8_t key, auto, auto) {
+            auto child = children + slot;
+            switch (kind) {
+                case NodeKind::Node4: m_node4[block].keys[slot] = key; m_node4[block].children[slot] = child; break;
+                case NodeKind::Node16: m_node16[block].keys[slot] = key; m_node16[block].children[slot] = child; break;
+                case NodeKind::Node48: m_node48[block].index[key] = static_cast<uint8_t>(slot + 1); m_node48[block].children[slot] = child; break;
+                case NodeKind::Node256: m_node256[block].children[key] = child; break;
+            }
+            ++slot;
+        });
+        return { depth + len, children };
+    }
+
+    // Build the node's whole subtree from sorted, distinct keys, splitting nothing and allocating only what the trie keeps
+    void build(NodeId id, std::string_view const* keys, size_t n, size_t depth, BuildCursor& at) {
+        auto [split, child] = layout(id, keys, n, depth, at);
+        forEachRun(keys + (keys[0].size() == split), keys + n, split, [&, split = split, child = child](uint8_t, auto first, auto last) mutable {
+            build(child++, first, static_cast<size_t>(last - first), split + 1, at);
+        });
+    }
+
+    // Append what a counting run found to the arenas, returning a cursor that writes into the appended space
+        // Each arena gets a single run, so builds writing through different cursors never touch the same elements
+    auto reserve(BuildCursor const& need, BuildMode mode = BuildMode::Write) -> BuildCursor {
+        BuildCursor at{ mode };
+        at.nodes = need.nodes ? m_nodes.append(need.nodes) : 0;
+        at.bytes = need.bytes ? m_bytes.append(need.bytes) : 0;
+        at.blocks[0] = need.blocks[0] ? m_node4.m_blocks.append(need.blocks[0]) : 0;
+        at.blocks[1] = need.blocks[1] ? m_node16.m_blocks.append(need.blocks[1]) : 0;
+        at.blocks[2] = need.blocks[2] ? m_node48.m_blocks.append(need.blocks[2]) : 0;
+        at.blocks[3] = need.blocks[3] ? m_node256.m_blocks.append(need.blocks[3]) : 0;
+        return at;
+    }
+
+    // Build the whole trie into the empty pool from sorted, distinct keys
+        // The subtrees below the root are split into `threads` ranges of about as many keys, each counted and then built on its own thread
+    void buildRoot(std::string_view const* keys, size_t n, unsigned threads) {
+        if (!n) return;
+        if (threads <= 1) {
+            BuildCursor at{ BuildMode::Append };
+            build(0, keys, n, 0, at);
             return;
         }
 
-        // Otherwise add a new branch for the new string
-            // NOTE: Population is guaranteed to be '1'
-        auto right = std::make_shared<Node>();
-        right->common = right->m_value = safeSubStr(str, len + 1);
-        m_children.push_back(right);
-        keys.push_back(str[len]);
+        BuildCursor need;
+        layout(0, keys, n, 0, need);
+        auto root = reserve(need);
+        auto placed = layout(0, keys, n, 0, root);
+        auto split = placed.first;
+
+        // Ranges of whole subtrees, with the id of each range's first subtree root
+        struct Range {
+            std::string_view const* first;
+            std::string_view const* last;
+            NodeId child;
+            BuildCursor at;
+        };
+        std::vector<Range> ranges;
+        auto per = n / threads + 1;
+        forEachRun(keys + (keys[0].size() == split), keys + n, split, [&, child = placed.second](uint8_t, auto first, auto last) mutable {
+            if (ranges.empty() || static_cast<size_t>(ranges.back().last - ranges.back().first) >= per) ranges.push_back({ first, last, child, {} });
+            ranges.back().last = last;
+            ++child;
+        });
 
-        return right;
+        auto inParallel = [&](auto&& fn) {
+            std::vector<std::thread> workers;
+            for (size_t r = 1; r < ranges.size(); ++r) workers.emplace_back([&, r] { fn(ranges[r]); });
+            if (!ranges.empty()) fn(ranges[0]);
+            for (auto& w : workers) w.join();
+        };
+        auto buildRange = [&](Range& range) {
+            auto child = range.child;
+            forEachRun(range.first, range.last, split, [&](uint8_t, auto first, auto last) {
+                build(child++, first, static_cast<size_t>(last - first), split + 1, range.at);
+            });
+        };
+
+        inParallel(buildRange);
+        for (auto& range : ranges) range.at = reserve(range.at);
+        inParallel(buildRange);
+    }
+
+    auto terminal(NodeId id) const { return m_nodes[id].terminal; }
+
+    auto childCount(NodeId id) const -> size_t { return m_nodes[id].count; }
+
+    auto bytesUsed() const -> size_t {
+        return m_nodes.bytesUsed() + m_freeNodes.capacity() * sizeof(NodeId) + m_bytes.bytesUsed()
+             + m_node4.bytesUsed() + m_node16.bytesUsed() + m_node48.bytesUsed() + m_node256.bytesUsed();
     }
 };
 
-class Trie {
-    auto find(std::string str) {
-        auto node = m_root.get();
-        
-        // The `getNext` function doesn't 
+// Forward iterator over keys in order, yielding views of a key buffer that is reused for every key
+    // A view is valid until the iterator moves on, nothing is allocated per key
+    // Walks any trie layout that can tell a node's label, whether it is terminal and its children in key order
+template <class Source>
+class BasicKeyIterator {
+    // Node being visited, where its label starts in the key buffer and the key of the last child visited
+        // (-2 while the node's own key hasn't been considered, -1 before its first child)
+    struct Frame {
+        NodeId id;
+        size_t start;
+        int after;
+    };
+
+    Source const* m_pool = nullptr;
+    std::vector<Frame> m_stack;
+    std::string m_key;
+    size_t m_left = 0;                  // Keys still to be yielded
+
+    // Move to the next key in the subtrees on the stack (or to the end)
+    void advance() {
+        while (!m_stack.empty()) {
+            auto& frame = m_stack.back();
+            if (frame.after == -2) {
+                frame.after = -1;
+                if (m_pool->terminal(frame.id)) return;
+                continue;
+            }
+
+            auto [key, child] = m_pool->nextChild(frame.id, frame.after);
+            if (child == noNode) {
+                m_stack.pop_back();
+                continue;
+            }
+
+            frame.after = key;
+            m_key.resize(frame.start + m_pool->label(frame.id).size());
+            m_key.push_back(static_cast<char>(key));
+            enter(child, -2);
+        }
+        m_left = 0;
+    }
+
+    void enter(NodeId id, int after) {
+        m_stack.push_back({ id, m_key.size(), after });
+        m_key.append(m_pool->label(id));
+    }
+
+    // Start at the first key that isn't below `bound` (or above it, with `inclusive` unset)
+        // Walks down the bound's path, leaving every node whose remaining keys may come after the bound on the stack
+    void seek(NodeId id, std::string_view bound, bool inclusive) {
         while (true) {
-            auto [next, left] = node->getNext(str);
-            
-            if (!next) break;
-            node = next;
-            
-            if (left == "") break;
-            str = left;
+            auto label = m_pool->label(id);
+            auto len = NodePool::commonPrefix(label, bound);
+            if (len < label.size() && len < bound.size()) {
+                // The label parts ways with the bound, so the whole subtree is either above or below it
+                if (static_cast<uint8_t>(label[len]) > static_cast<uint8_t>(bound[len])) enter(id, -2);
+                return;
+            }
+
+            // The bound ends inside (or at the end of) the label, so the subtree's keys start at or after it
+            if (len == bound.size()) {
+                enter(id, len < label.size() || inclusive ? -2 : -1);
+                return;
+            }
+
+            // The node's own key is a prefix of the bound, so only children past the bound's next character can follow
+            auto next = static_cast<uint8_t>(bound[len]);
+            enter(id, next);
+            auto child = m_pool->findChild(id, bound[len]);
+            if (child == noNode) return;
+
+            m_key.resize(m_stack.back().start + label.size());
+            m_key.push_back(bound[len]);
+            bound.remove_prefix(len + 1);
+            id = child;
+        }
+    }
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::string_view;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::string_view const*;
+        using reference = std::string_view;
+
+        // End of every range
+        BasicKeyIterator() = default;
+
+        // Keys of the node's subtree in order, `path` being the key up to the node's label
+        BasicKeyIterator(Source const& pool, NodeId id, std::string_view path, size_t limit)
+                : m_pool{ &pool }, m_key{ path }, m_left{ limit } {
+            if (!m_left || id == noNode) return;
+            enter(id, -2);
+            advance();
+        }
+
+        // Keys from the bound on (past it unless `inclusive`), up to `limit` of them
+        BasicKeyIterator(Source const& pool, NodeId root, std::string_view bound, bool inclusive, size_t limit)
+                : m_pool{ &pool }, m_left{ limit } {
+            if (!m_left) return;
+            seek(root, bound, inclusive);
+            advance();
+        }
+
+        auto operator*() const -> std::string_view { return m_key; }
+
+        auto operator++() -> BasicKeyIterator& {
+            if (!--m_left) m_stack.clear();
+            else advance();
+            return *this;
         }
-        
-        return std::tuple{ node, str };
+
+        // Only compares against the end
+        auto operator==(BasicKeyIterator const& other) const { return m_stack.empty() == other.m_stack.empty(); }
+        auto operator!=(BasicKeyIterator const& other) const { return !(*this == other); }
+};
+
+// Range of keys for range-based for loops
+template <class Source>
+struct BasicKeyRange {
+    BasicKeyIterator<Source> first;
+
+    auto begin() const { return first; }
+    auto end() const { return BasicKeyIterator<Source>{}; }
+};
+
+using KeyIterator = BasicKeyIterator<NodePool>;
+using KeyRange = BasicKeyRange<NodePool>;
+
+// Get the node whose subtree holds exactly the keys starting with the prefix, with the key up to its label
+template <class Source>
+auto findPrefixNode(Source const& source, std::string_view prefix) -> std::pair<NodeId, std::string_view> {
+    NodeId id = 0;
+    size_t used = 0;
+    while (id != noNode) {
+        auto label = source.label(id);
+        auto rest = prefix.substr(used);
+        auto len = NodePool::commonPrefix(label, rest);
+
+        if (len == rest.size()) return { id, prefix.substr(0, used) };
+        if (len < label.size()) break;
+
+        used += len + 1;
+        id = source.findChild(id, rest[len]);
     }
+    return { noNode, {} };
+}
 
-    NodePtr m_root = std::make_shared<Node>();
+// Layout of a frozen trie image, which holds no pointers so it can be written out and mapped back in as it is
+    // Nodes are numbered level by level from the root (0), and every section starts at an 8-byte aligned offset in the image
+    // Integers are in the byte order of the machine that froze the trie, `order` tells a reader whether that is its own
+struct FrozenHeader {
+    char magic[8];
+    uint64_t order;
+    uint64_t keys;
+    uint64_t nodes;
+    uint64_t louds;             // Each node's child count in unary (that many ones, then a zero), 2 * nodes - 1 bits
+    uint64_t terminal;          // A bit per node for whether a key ends there
+    uint64_t labelled;          // A bit per node for whether it has a label
+    uint64_t edges;             // A byte per node for the key its parent holds it under
+    uint64_t labelStarts;       // Where each labelled node's label starts in `labels`, followed by the end of the last one
+    uint64_t labels;            // The labels back to back
+    uint64_t size;              // Bytes in the whole image
+};
+
+constexpr char frozenMagic[8] = { 'T', 'R', 'I', 'E', 'L', 'O', 'U', 'D' };
+constexpr uint64_t frozenOrder = 0x0102030405060708;
+
+// Append the bytes to the image as a section of their own, returning its offset
+inline auto appendSection(std::string& image, void const* data, size_t bytes) -> uint64_t {
+    auto at = image.size();
+    image.append(static_cast<char const*>(data), bytes);
+    image.resize((image.size() + 7) & ~size_t{ 7 });
+    return at;
+}
+
+// Bit vector in a frozen image: the bits in 64-bit words, followed by the number of ones before every block of 512 bits
+class FrozenBits {
+    static constexpr size_t blockWords = 8;
+
+    uint64_t const* m_words = nullptr;
+    uint32_t const* m_ranks = nullptr;
+    size_t m_blocks = 0;
 
     public:
-        enum class InsertionResult{ WasInserted, AlreadyExists };
+        FrozenBits() = default;
+        FrozenBits(char const* at, size_t bits)
+                : m_words{ reinterpret_cast<uint64_t const*>(at) },
+                  m_ranks{ reinterpret_cast<uint32_t const*>(at + (bits + 63) / 64 * sizeof(uint64_t)) },
+                  m_blocks{ ((bits + 63) / 64 + blockWords - 1) / blockWords } {}
+
+        // Append the words and their block ranks to the image, returning their offset
+        static auto write(std::string& image, std::vector<uint64_t> const& words) -> uint64_t {
+            std::vector<uint32_t> ranks{ 0 };
+            for (size_t w = 0; w < words.size(); w += blockWords) {
+                auto ones = ranks.back();
+                for (auto i = w; i != std::min(w + blockWords, words.size()); ++i) ones += popCount(words[i]);
+                ranks.push_back(ones);
+            }
 
-        auto insert(std::string const& str) {
-            // while (true);
-            auto [node, sub] = find(str);
+            auto at = appendSection(image, words.data(), words.size() * sizeof(uint64_t));
+            appendSection(image, ranks.data(), ranks.size() * sizeof(uint32_t));
+            return at;
+        }
+
+        auto test(size_t pos) const -> bool { return m_words[pos / 64] >> (pos % 64) & 1; }
 
-            if (node->m_value == str) return InsertionResult::AlreadyExists;
-            if (node->m_value == "") {
-                node->common = node->m_value = str;
+        // Number of ones before the position
+        auto rank1(size_t pos) const -> size_t {
+            size_t rank = m_ranks[pos / 512];
+            for (auto w = pos / 512 * blockWords; w != pos / 64; ++w) rank += popCount(m_words[w]);
+            if (pos % 64) rank += popCount(m_words[pos / 64] & ((uint64_t{ 1 } << (pos % 64)) - 1));
+            return rank;
+        }
 
-            } else {
-                node->splitWith(sub)->m_value = str;
+        // Position of the zero with the given index (counting from 0), which has to exist
+            // Finds the block by binary search over the ranks, then the word by counting
+        auto select0(size_t k) const -> size_t {
+            size_t lo = 0, hi = m_blocks;
+            while (hi - lo > 1) {
+                auto mid = (lo + hi) / 2;
+                if (mid * 512 - m_ranks[mid] <= k) lo = mid;
+                else hi = mid;
             }
 
+            k -= lo * 512 - m_ranks[lo];
+            for (auto w = lo * blockWords;; ++w) {
+                auto zeros = ~m_words[w];
+                auto count = popCount(zeros);
+                if (k < count) {
+                    for (; k; --k) zeros &= zeros - 1;
+                    return w * 64 + lowestBit(zeros);
+                }
+                k -= count;
+            }
+        }
+};
+
+// Read-only trie queried in place in a frozen image, which it doesn't own (typically a mapped file)
+    // The nodes are encoded level by level in LOUDS form, a few bits each plus their edge key and label bytes
+    // Opening an image only checks its header, the image's contents are trusted beyond that
+class FrozenTrie {
+    FrozenHeader const* m_header = nullptr;
+    FrozenBits m_louds;
+    FrozenBits m_terminal;
+    FrozenBits m_labelled;
+    uint8_t const* m_edges = nullptr;
+    uint32_t const* m_labelStarts = nullptr;
+    char const* m_labels = nullptr;
+
+    // Ids of the first child and one past the last child of the node
+        // The node's ones follow the zero that ends the node before it, and every one before them stands for an earlier child
+    auto children(NodeId id) const -> std::pair<NodeId, NodeId> {
+        auto start = id ? m_louds.select0(id - 1) + 1 : 0;
+        auto end = m_louds.select0(id);
+        auto first = static_cast<NodeId>(m_louds.rank1(start) + 1);
+        return { first, static_cast<NodeId>(first + (end - start)) };
+    }
+
+    public:
+        explicit FrozenTrie(std::string_view image) {
+            if (image.size() < sizeof(FrozenHeader) || reinterpret_cast<uintptr_t>(image.data()) % alignof(uint64_t))
+                throw std::invalid_argument{ "frozen trie image is truncated or misaligned" };
+
+            m_header = reinterpret_cast<FrozenHeader const*>(image.data());
+            if (!std::equal(std::begin(frozenMagic), std::end(frozenMagic), m_header->magic) || m_header->order != frozenOrder)
+                throw std::invalid_argument{ "not a frozen trie image (or one frozen on a machine of the other byte order)" };
+            if (m_header->size != image.size())
+                throw std::invalid_argument{ "frozen trie image is truncated" };
+
+            auto at = image.data();
+            m_louds = FrozenBits{ at + m_header->louds, 2 * m_header->nodes - 1 };
+            m_terminal = FrozenBits{ at + m_header->terminal, m_header->nodes };
+            m_labelled = FrozenBits{ at + m_header->labelled, m_header->nodes };
+            m_edges = reinterpret_cast<uint8_t const*>(at + m_header->edges);
+            m_labelStarts = reinterpret_cast<uint32_t const*>(at + m_header->labelStarts);
+            m_labels = at + m_header->labels;
+        }
+
+        // Freeze the trie in the pool into an image, numbering its nodes level by level
+        static auto freeze(NodePool const& pool, size_t keys) -> std::string {
+            std::vector<NodeId> order{ 0 };
+            std::vector<uint8_t> edges{ 0 };
+            std::vector<uint64_t> louds, terminal, labelled;
+            std::vector<uint32_t> labelStarts{ 0 };
+            std::string labels;
+
+            auto push = [](std::vector<uint64_t>& words, size_t pos, bool bit) {
+                if (pos % 64 == 0) words.push_back(0);
+                words.back() |= uint64_t{ bit } << (pos % 64);
+            };
+
+            size_t loudsBits = 0;
+            for (size_t i = 0; i != order.size(); ++i) {
+                auto id = order[i];
+                pool.forEachChild(id, [&](uint8_t key, NodeId child) {
+                    order.push_back(child);
+                    edges.push_back(key);
+                    push(louds, loudsBits++, true);
+                });
+                push(louds, loudsBits++, false);
+                push(terminal, i, pool.terminal(id));
+
+                auto label = pool.label(id);
+                push(labelled, i, !label.empty());
+                if (!label.empty()) {
+                    labels.append(label);
+                    labelStarts.push_back(static_cast<uint32_t>(labels.size()));
+                }
+            }
+
+            FrozenHeader header{};
+            std::copy(std::begin(frozenMagic), std::end(frozenMagic), header.magic);
+            header.order = frozenOrder;
+            header.keys = keys;
+            header.nodes = order.size();
+
+            // The header goes in last, once the sections' offsets are known
+            std::string image(sizeof(FrozenHeader), '\0');
+            header.louds = FrozenBits::write(image, louds);
+            header.terminal = FrozenBits::write(image, terminal);
+            header.labelled = FrozenBits::write(image, labelled);
+            header.edges = appendSection(image, edges.data(), edges.size());
+            header.labelStarts = appendSection(image, labelStarts.data(), labelStarts.size() * sizeof(uint32_t));
+            header.labels = appendSection(image, labels.data(), labels.size());
+            header.size = image.size();
+            std::memcpy(image.data(), &header, sizeof(header));
+            return image;
+        }
+
+        auto label(NodeId id) const -> std::string_view {
+            if (!m_labelled.test(id)) return {};
+            auto idx = m_labelled.rank1(id);
+            return { m_labels + m_labelStarts[idx], m_labelStarts[idx + 1] - m_labelStarts[idx] };
+        }
+
+        auto terminal(NodeId id) const -> bool { return m_terminal.test(id); }
+
+        // Siblings sit next to each other in key order, so their edge keys can be searched directly
+        auto findChild(NodeId id, char c) const -> NodeId {
+            auto [first, last] = children(id);
+            auto key = static_cast<uint8_t>(c);
+            auto at = std::lower_bound(m_edges + first, m_edges + last, key);
+            return at != m_edges + last && *at == key ? static_cast<NodeId>(at - m_edges) : noNode;
+        }
+
+        // Get the child with the smallest key above `after` (-1 for the first child), noNode when there is none
+        auto nextChild(NodeId id, int after) const -> std::pair<int, NodeId> {
+            auto [first, last] = children(id);
+            auto at = after < 0 ? m_edges + first : std::upper_bound(m_edges + first, m_edges + last, static_cast<uint8_t>(after));
+            if (at == m_edges + last) return { 256, noNode };
+            return { *at, static_cast<NodeId>(at - m_edges) };
+        }
+
+        auto exists(std::string_view str) const -> bool {
+            NodeId id = 0;
+            while (true) {
+                auto label = this->label(id);
+                if (str.substr(0, label.size()) != label) return false;
+
+                str.remove_prefix(label.size());
+                if (str.empty()) return terminal(id);
+
+                id = findChild(id, str[0]);
+                if (id == noNode) return false;
+                str.remove_prefix(1);
+            }
+        }
+
+        // Keys starting with the prefix in order, at most `limit` of them
+        auto prefixScan(std::string_view prefix, size_t limit = std::numeric_limits<size_t>::max()) const {
+            auto [id, path] = size() ? findPrefixNode(*this, prefix) : std::pair<NodeId, std::string_view>{ noNode, {} };
+            return BasicKeyRange<FrozenTrie>{ BasicKeyIterator<FrozenTrie>{ *this, id, path, limit } };
+        }
+
+        // Every key in order
+        auto keys() const { return prefixScan( "" ); }
+
+        auto size() const -> size_t { return m_header->keys; }
+
+        auto bytesUsed() const -> size_t { return m_header->size; }
+};
+
+// Read-only view of a whole file, mapped into memory where the platform allows so processes opening it share its pages
+    // Elsewhere the file is read into memory instead
+class MappedFile {
+    std::string_view m_bytes;
+#if !defined(__unix__) && !defined(__APPLE__)
+    std::string m_copy;
+#endif
+
+    public:
+        explicit MappedFile(std::string const& path) {
+#if defined(__unix__) || defined(__APPLE__)
+            auto fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) throw std::runtime_error{ "can't open " + path };
+
+            struct stat info;
+            if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+                auto addr = ::mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+                if (addr != MAP_FAILED) m_bytes = { static_cast<char const*>(addr), static_cast<size_t>(info.st_size) };
+            }
+            ::close(fd);
+            if (m_bytes.empty()) throw std::runtime_error{ "can't map " + path };
+#else
+            std::ifstream in(path, std::ios::binary);
+            if (!in) throw std::runtime_error{ "can't open " + path };
+            m_copy.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+            m_bytes = m_copy;
+#endif
+        }
+
+        MappedFile(MappedFile const&) = delete;
+        auto operator=(MappedFile const&) -> MappedFile& = delete;
+
+        ~MappedFile() {
+#if defined(__unix__) || defined(__APPLE__)
+            ::munmap(const_cast<char*>(m_bytes.data()), m_bytes.size());
+#endif
+        }
+
+        auto bytes() const { return m_bytes; }
+};
+
+enum class InsertionResult{ WasInserted, AlreadyExists };
+
+// Values of a map trie, in slots the nodes refer to by index
+    // Slots never move, so a pointer to a value stays valid until its key is erased
+template <class V>
+struct ValueSlots {
+    StableVector<std::optional<V>> m_slots;
+    std::vector<uint32_t> m_free;
+
+    auto add() -> uint32_t {
+        if (m_free.empty()) return static_cast<uint32_t>(m_slots.append());
+
+        auto slot = m_free.back();
+        m_free.pop_back();
+        return slot;
+    }
+
+    void release(uint32_t slot) {
+        m_slots[slot].reset();
+        m_free.push_back(slot);
+    }
+
+    auto bytesUsed() const -> size_t { return m_slots.bytesUsed() + m_free.capacity() * sizeof(uint32_t); }
+};
+
+// A set has no values
+template <>
+struct ValueSlots<void> {
+    void release(uint32_t) {}
+    auto bytesUsed() const -> size_t { return 0; }
+};
+
+// Set of strings, or a map from strings to V
+    // Every query takes a string_view and walks the nodes without allocating
+template <class V = void>
+class Trie {
+    NodePool m_pool;
+    ValueSlots<V> m_values;
+    size_t m_size = 0;
+
+    public:
+        using InsertionResult = ::InsertionResult;
+
+        Trie() = default;
+
+        // Build the set from the keys in one pass, without the node splits of inserting them one at a time
+            // The keys are sorted (and duplicates dropped) first unless they already are, `threads` threads build the subtrees below the root
+        template <class U = V, std::enable_if_t<std::is_void_v<U>, int> = 0>
+        explicit Trie(std::vector<std::string_view> keys, unsigned threads = 1) {
+            if (!std::is_sorted(keys.begin(), keys.end())) std::sort(keys.begin(), keys.end());
+            keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+            m_pool.buildRoot(keys.data(), keys.size(), threads);
+            m_size = keys.size();
+        }
+
+        template <class U = V, std::enable_if_t<std::is_void_v<U>, int> = 0>
+        auto insert(std::string_view str) {
+            if (!m_pool.insertBelow(0, str, nullptr).second) return InsertionResult::AlreadyExists;
+
+            ++m_size;
+            return InsertionResult::WasInserted;
+        }
+
+        // Map the string to the value, replacing the value it had if it was already there
+        template <class U = V, std::enable_if_t<!std::is_void_v<U>, int> = 0>
+        auto insertOrAssign(std::string_view str, U value) {
+            auto [id, inserted] = m_pool.insertBelow(0, str, nullptr);
+            auto& node = m_pool.m_nodes[id];
+            if (inserted) {
+                node.value = m_values.add();
+                ++m_size;
+            }
+
+            m_values.m_slots[node.value] = std::move(value);
+            return inserted ? InsertionResult::WasInserted : InsertionResult::AlreadyExists;
+        }
+
+        // Get the string's value, null when it isn't in the map
+        template <class U = V, std::enable_if_t<!std::is_void_v<U>, int> = 0>
+        auto find(std::string_view str) -> U* {
+            auto id = m_pool.findKey(0, str);
+            return id == noNode ? nullptr : &*m_values.m_slots[m_pool.m_nodes[id].value];
+        }
+
+        template <class U = V, std::enable_if_t<!std::is_void_v<U>, int> = 0>
+        auto find(std::string_view str) const -> U const* {
+            auto id = m_pool.findKey(0, str);
+            return id == noNode ? nullptr : &*m_values.m_slots[m_pool.m_nodes[id].value];
+        }
+
+        // Erase the string (and its value), returning whether it was there
+            // Emptied nodes go back to the pool, their parents shrink to a smaller layout when they can,
+            // and a node left with a single child and no key is merged with the child
+        auto erase(std::string_view str) {
+            NodePool::Erased erased;
+            if (m_pool.eraseBelow(0, str, erased, nullptr)) m_pool.m_nodes[0].length = 0;
+            if (erased.value != noValue) m_values.release(erased.value);
+
+            m_size -= erased.found;
+            return erased.found;
+        }
+
+        auto exists(std::string_view str) const { return m_pool.contains(0, str); }
+
+        // Get the node whose subtree holds exactly the keys starting with the prefix, with the key up to its label
+        auto findPrefix(std::string_view prefix) const -> std::pair<NodeId, std::string_view> {
+            if (!m_size) return { noNode, {} };
+            return findPrefixNode(m_pool, prefix);
+        }
+
+        // Number of keys starting with the prefix, from the counts cached in the nodes
+        auto countPrefix(std::string_view prefix) const -> size_t {
+            auto [id, _] = findPrefix(prefix);
+            return id == noNode ? 0 : m_pool.m_nodes[id].keys;
+        }
+
+        // Keys starting with the prefix in order, at most `limit` of them
+        auto prefixScan(std::string_view prefix, size_t limit = std::numeric_limits<size_t>::max()) const {
+            auto [id, path] = findPrefix(prefix);
+            return KeyRange{ KeyIterator{ m_pool, id, path, limit } };
+        }
+
+        // Keys in order from the first one that isn't less than `key`
+        auto lowerBound(std::string_view key, size_t limit = std::numeric_limits<size_t>::max()) const {
+            return KeyRange{ m_size ? KeyIterator{ m_pool, 0, key, true, limit } : KeyIterator{} };
+        }
+
+        // Keys in order from the first one that is greater than `key`
+        auto upperBound(std::string_view key, size_t limit = std::numeric_limits<size_t>::max()) const {
+            return KeyRange{ m_size ? KeyIterator{ m_pool, 0, key, false, limit } : KeyIterator{} };
+        }
+
+        // Every key in order
+        auto keys() const { return lowerBound( "" ); }
+
+        // Freeze the trie into a compact image that a FrozenTrie queries in place, e.g. after writing it to a file and mapping it back
+        auto freeze() const { return FrozenTrie::freeze(m_pool, m_size); }
+
+        auto size() const { return m_size; }
+
+        // Bytes held by the node pool and label arena (including spare capacity)
+        auto bytesUsed() const { return m_pool.bytesUsed() + m_values.bytesUsed(); }
+};
+
+// Epoch slot of a reading thread, on its own cache line
+struct alignas(64) EpochSlot {
+    std::atomic<uint64_t> pinned{ 0 };      // Epoch the thread started reading in (0 while it isn't reading)
+    std::atomic<bool> taken{ false };
+};
+
+// Process-wide epochs that tell a writer when the nodes it replaced can no longer be seen by any reader
+    // A reader pins the epoch it started in with a store to its own slot, so lookups never wait or retry
+class Epochs {
+    using Slot = EpochSlot;
+
+    static constexpr size_t maxThreads = 256;
+    inline static Slot s_slots[maxThreads];
+    inline static std::atomic<size_t> s_used{ 0 };         // Slots ever taken, so writers only scan those
+    inline static std::atomic<uint64_t> s_epoch{ 1 };
+
+    // Slot of the calling thread, taken on its first lookup and given back when the thread exits
+    static auto slot() -> Slot& {
+        struct Owner {
+            Slot* slot = nullptr;
+
+            Owner() {
+                for (size_t i{}; i != maxThreads; ++i) {
+                    if (s_slots[i].taken.load() || s_slots[i].taken.exchange(true)) continue;
+
+                    slot = &s_slots[i];
+                    for (auto used = s_used.load(); used <= i && !s_used.compare_exchange_weak(used, i + 1); ) {}
+                    return;
+                }
+                throw std::length_error{ "too many threads reading concurrent tries" };
+            }
+
+            ~Owner() { slot->taken.store(false); }
+        };
+
+        thread_local Owner owner;
+        return *owner.slot;
+    }
+
+    public:
+        // Keeps every node that was reachable when it was created from being reused until it is destroyed
+        class Guard {
+            Slot& m_slot;
+            bool m_outer;
+
+            public:
+                Guard() : m_slot{ slot() }, m_outer{ !m_slot.pinned.load(std::memory_order_relaxed) } {
+                    if (m_outer) m_slot.pinned.store(s_epoch.load());
+                }
+                ~Guard() { if (m_outer) m_slot.pinned.store(0, std::memory_order_release); }
+
+                Guard(Guard const&) = delete;
+                auto operator=(Guard const&) -> Guard& = delete;
+        };
+
+        // Start a new epoch, returning the one that just ended
+        static auto advance() -> uint64_t { return s_epoch.fetch_add(1); }
+
+        // Every epoch before the returned one has no reader left
+        static auto oldestPinned() -> uint64_t {
+            auto oldest = s_epoch.load();
+            for (size_t i{}; i != s_used.load(); ++i)
+                if (auto epoch = s_slots[i].pinned.load(); epoch && epoch < oldest) oldest = epoch;
+            return oldest;
+        }
+};
+
+// Trie that any number of threads can read while writers take turns
+    // Lookups are wait-free: they pin an epoch, load the root and walk nodes that never change once published
+    // Writers copy the path they change, publish the new root and retire the replaced nodes,
+    // which go back to the pool once every reader that could have seen them is done
+class ConcurrentTrie {
+    NodePool m_pool;
+    std::atomic<NodeId> m_root{ 0 };
+    std::atomic<size_t> m_size{ 0 };
+    std::mutex m_write;
+
+    NodePool::Replaced m_replaced;
+    std::vector<std::pair<uint64_t, NodeId>> m_retired;     // Replaced nodes and the epoch they were replaced in
+
+    // Retired nodes are only reclaimed in batches, as checking the readers means scanning every slot
+    static constexpr size_t reclaimBatch = 256;
+
+    // Apply `change(root, replaced)` to a copy of the root, then publish it (the write lock must be held)
+    template <class Change>
+    void write(Change&& change) {
+        auto old = m_root.load(std::memory_order_relaxed);
+        auto root = m_pool.clone(old);
+        m_replaced.push_back(old);
+
+        change(root, &m_replaced);
+        m_root.store(root);
+
+        auto epoch = Epochs::advance();
+        for (auto id : m_replaced) m_retired.emplace_back(epoch, id);
+        m_replaced.clear();
+
+        if (m_retired.size() >= reclaimBatch) reclaim();
+    }
+
+    void reclaim() {
+        auto oldest = Epochs::oldestPinned();
+        auto done = std::find_if(m_retired.begin(), m_retired.end(), [oldest](auto& r) { return r.first >= oldest; });
+
+        for (auto it = m_retired.begin(); it != done; ++it) m_pool.releaseNode(it->second);
+        m_retired.erase(m_retired.begin(), done);
+    }
+
+    public:
+        using InsertionResult = ::InsertionResult;
+
+        auto insert(std::string_view str) {
+            std::lock_guard<std::mutex> lock{ m_write };
+            if (m_pool.contains(m_root.load(std::memory_order_relaxed), str)) return InsertionResult::AlreadyExists;
+
+            write([&](NodeId root, NodePool::Replaced* replaced) { m_pool.insertBelow(root, str, replaced); });
+            m_size.fetch_add(1, std::memory_order_relaxed);
             return InsertionResult::WasInserted;
         }
 
-        auto exists(std::string const& str) {
-            auto [node, _] = find(str);
-            return node->m_value == str;
+        auto erase(std::string_view str) {
+            std::lock_guard<std::mutex> lock{ m_write };
+            if (!m_pool.contains(m_root.load(std::memory_order_relaxed), str)) return false;
+
+            write([&](NodeId root, NodePool::Replaced* replaced) {
+                NodePool::Erased erased;
+                if (m_pool.eraseBelow(root, str, erased, replaced)) m_pool.m_nodes[root].length = 0;
+            });
+            m_size.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        auto exists(std::string_view str) const {
+            Epochs::Guard guard;
+            return m_pool.contains(m_root.load(), str);
         }
+
+        auto size() const { return m_size.load(std::memory_order_relaxed); }
 };
 
 // You can use this function to write any tests you may want.
 void tests() {
+    // Keys that end inside another key's label or at the root
+    Trie<> trie;
+    CHECK( trie.exists( "" ) == false );
+    CHECK( trie.insert( "abc" ) == Trie<>::InsertionResult::WasInserted );
+    CHECK( trie.insert( "ab" ) == Trie<>::InsertionResult::WasInserted );
+    CHECK( trie.insert( "abd" ) == Trie<>::InsertionResult::WasInserted );
+    CHECK( trie.insert( "" ) == Trie<>::InsertionResult::WasInserted );
+    CHECK( trie.insert( "ab" ) == Trie<>::InsertionResult::AlreadyExists );
 
+    CHECK( trie.size() == 4 );
+    CHECK( trie.exists( "" ) );
+    CHECK( trie.exists( "ab" ) );
+    CHECK( trie.exists( "abd" ) );
+    CHECK( trie.exists( "a" ) == false );
+    CHECK( trie.exists( "abcd" ) == false );
 }
 
-// Tracking for tests (static_casts are just so we can keep noisy test code out of the Node class)
-std::set<Node*> g_allNodes;
-DebugNodeTracker::DebugNodeTracker() { g_allNodes.insert( static_cast<Node*>( this ) ); }
-DebugNodeTracker::~DebugNodeTracker() { g_allNodes.erase( static_cast<Node*>( this ) ); }
+// Tracking for tests (static_casts are just so we can keep noisy test code out of the NodePool class)
+    // Nodes live in their trie's pool, so the pools are tracked and each reports the child links of all its nodes
+std::set<NodePool*> g_allNodes;
+DebugNodeTracker::DebugNodeTracker() { g_allNodes.insert( static_cast<NodePool*>( this ) ); }
+DebugNodeTracker::DebugNodeTracker( DebugNodeTracker const& ) : DebugNodeTracker() {}
+DebugNodeTracker::~DebugNodeTracker() { g_allNodes.erase( static_cast<NodePool*>( this ) ); }
+
+auto DebugNodeTracker::getSlotCount() const -> size_t {
+    auto pool = static_cast<NodePool const*>( this );
 
-auto DebugNodeTracker::getSlotCount() const -> size_t { return static_cast<Node const*>( this )->m_children.size(); }
+    size_t count = 0;
+    for( NodeId id = 0; id != pool->m_nodes.size(); ++id ) count += pool->childCount( id );
+    return count;
+}
 
 auto totalChildNodeSlots() {
     return std::accumulate( g_allNodes.begin(), g_allNodes.end(), 0, []( auto count, auto node ) { return count + node->getSlotCount(); } );
 }
 
+// Heap allocations made on each thread, so tests can check that lookups don't allocate
+    // The operators stay out of line, or GCC matches the malloc and free inside them against new and delete and warns
+thread_local size_t g_allocations = 0;
+
+NOINLINE void* operator new( size_t size ) {
+    ++g_allocations;
+    if( auto p = std::malloc( size ? size : 1 ) ) return p;
+    throw std::bad_alloc{};
+}
+NOINLINE void* operator new( size_t size, std::nothrow_t const& ) noexcept {
+    ++g_allocations;
+    return std::malloc( size ? size : 1 );
+}
+NOINLINE void operator delete( void* p ) noexcept { std::free( p ); }
+NOINLINE void operator delete( void* p, size_t ) noexcept { std::free( p ); }
+
 // Serialisation for result type enum, in case of test failure
-auto operator <<( std::ostream& os, Trie::InsertionResult resultType ) -> std::ostream& {
+auto operator <<( std::ostream& os, InsertionResult resultType ) -> std::ostream& {
     switch( resultType ) {
-        case Trie::InsertionResult::WasInserted: return os << "WasInserted";
-        case Trie::InsertionResult::AlreadyExists: return os << "AlreadyExists";
+        case InsertionResult::WasInserted: return os << "WasInserted";
+        case InsertionResult::AlreadyExists: return os << "AlreadyExists";
         default: return os << "{** Unrecognised enum value: " << (int)resultType << "**}";
     }
 }
 
 // Helper to build an example trie
 auto buildTrie() {
-    Trie trie;
+    Trie<> trie;
 
-    CHECK( trie.insert( "hello" ) == Trie::InsertionResult::WasInserted );
-    CHECK( trie.insert( "hello" ) == Trie::InsertionResult::AlreadyExists );
-    CHECK( trie.insert( "hell" ) == Trie::InsertionResult::WasInserted );
-    CHECK( trie.insert( "hello world" ) == Trie::InsertionResult::WasInserted );
+    CHECK( trie.insert( "hello" ) == Trie<>::InsertionResult::WasInserted );
+    CHECK( trie.insert( "hello" ) == Trie<>::InsertionResult::AlreadyExists );
+    CHECK( trie.insert( "hell" ) == Trie<>::InsertionResult::WasInserted );
+    CHECK( trie.insert( "hello world" ) == Trie<>::InsertionResult::WasInserted );
 
     return trie;
 }
@@ -219,6 +1715,403 @@ TEST_CASE( "The minimum child array memory is used" ) {
         CHECK( childNodeSlots <= 6 );
     SECTION( "best" )
         CHECK( childNodeSlots <= 3 );
+    SECTION( "bytes per key" ) {
+        // Nodes and labels share two arenas, so a key costs a few dozen bytes even with the arenas' spare capacity
+        Trie<> index;
+        for( int i = 0; i != 100000; ++i )
+            index.insert( "user:" + std::to_string( i * 7919 % 1000003 ) );
+
+        REQUIRE( index.size() == 100000 );
+        INFO( "bytes used: " << index.bytesUsed() );
+        CHECK( index.bytesUsed() / index.size() <= 64 );
+    }
+}
+
+TEST_CASE( "Nodes adapt their layout to their fan-out" ) {
+    g_allNodes.clear();
+
+    Trie<> trie;
+    CHECK( trie.insert( "k" ) == Trie<>::InsertionResult::WasInserted );
+    auto pool = *g_allNodes.begin();
+
+    // Every byte value can follow the shared prefix
+    auto key = []( int i ) { return std::string{ 'k', static_cast<char>( i ) }; };
+    auto kindAfter = [&]( int keys ) {
+        for( int i = 0; i != 256; ++i ) {
+            if( i < keys ) trie.insert( key( i ) );
+            else trie.erase( key( i ) );
+        }
+        return pool->m_nodes[0].kind;
+    };
+
+    CHECK( kindAfter( 4 ) == NodeKind::Node4 );
+    CHECK( kindAfter( 16 ) == NodeKind::Node16 );
+    CHECK( kindAfter( 48 ) == NodeKind::Node48 );
+    CHECK( kindAfter( 256 ) == NodeKind::Node256 );
+
+    for( int i = 0; i != 256; ++i )
+        CHECK( trie.exists( key( i ) ) );
+
+    CHECK( kindAfter( 37 ) == NodeKind::Node48 );
+    CHECK( kindAfter( 12 ) == NodeKind::Node16 );
+    CHECK( kindAfter( 3 ) == NodeKind::Node4 );
+
+    CHECK( trie.size() == 4 );
+    CHECK( trie.exists( key( 2 ) ) );
+    CHECK( trie.exists( key( 3 ) ) == false );
+
+    CHECK( trie.erase( "k" ) );
+    CHECK( trie.erase( "k" ) == false );
+    CHECK( trie.exists( "k" ) == false );
+    CHECK( trie.exists( key( 0 ) ) );
+}
+
+TEST_CASE( "Readers never miss a key while a writer changes the trie" ) {
+    ConcurrentTrie trie;
+    for( int i = 0; i != 1000; ++i )
+        trie.insert( "stable:" + std::to_string( i ) );
+
+    std::atomic<bool> done{ false };
+    std::atomic<size_t> misses{ 0 };
+    std::vector<std::thread> readers;
+    for( int t = 0; t != 4; ++t ) {
+        readers.emplace_back( [&] {
+            while( !done ) {
+                for( int i = 0; i != 1000; ++i )
+                    if( !trie.exists( "stable:" + std::to_string( i ) ) ) ++misses;
+            }
+        } );
+    }
+
+    // Splits the stable keys' nodes, then erases the new keys again so nodes are retired and reused
+    for( int round = 0; round != 4; ++round ) {
+        for( int i = 0; i != 5000; ++i ) trie.insert( "stable:" + std::to_string( i % 1000 ) + ":" + std::to_string( i ) );
+        for( int i = 0; i != 5000; ++i ) trie.erase( "stable:" + std::to_string( i % 1000 ) + ":" + std::to_string( i ) );
+    }
+
+    done = true;
+    for( auto& r : readers ) r.join();
+
+    CHECK( misses == 0 );
+    CHECK( trie.size() == 1000 );
+    CHECK( trie.exists( "stable:999" ) );
+    CHECK( trie.exists( "stable:999:4999" ) == false );
+}
+
+// Lookup-heavy throughput (1 write in 16 operations) of the concurrent trie against a trie behind a mutex
+    // Run explicitly with the "[.benchmark]" tag
+TEST_CASE( "Concurrent trie throughput", "[.benchmark]" ) {
+    constexpr int preload = 200000;
+    auto key = []( uint64_t i ) { return "key:" + std::to_string( i * 2654435761u % 1000003 ); };
+
+    ConcurrentTrie concurrent;
+    Trie<> locked;
+    std::mutex lock;
+    for( int i = 0; i != preload; ++i ) {
+        concurrent.insert( key( i ) );
+        locked.insert( key( i ) );
+    }
+
+    // Run `op(thread, i)` on every thread for a fixed time, returning millions of operations per second
+    auto run = []( int threads, auto&& op ) {
+        std::atomic<bool> stop{ false };
+        std::atomic<uint64_t> total{ 0 };
+        std::vector<std::thread> workers;
+
+        auto start = std::chrono::steady_clock::now();
+        for( int t = 0; t != threads; ++t ) {
+            workers.emplace_back( [&, t] {
+                uint64_t i = 0;
+                for( ; !stop.load( std::memory_order_relaxed ); ++i ) op( t, i );
+                total += i;
+            } );
+        }
+        std::this_thread::sleep_for( std::chrono::milliseconds( 200 ) );
+        stop = true;
+        for( auto& w : workers ) w.join();
+
+        auto secs = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+        return total / secs / 1e6;
+    };
+
+    std::cout << "threads  concurrent Mops/s  mutex Mops/s\n";
+    for( int threads = 1; threads <= 64; threads *= 2 ) {
+        auto fresh = [threads]( int t, uint64_t i ) { return "new:" + std::to_string( threads ) + ":" + std::to_string( t ) + ":" + std::to_string( i ); };
+
+        auto c = run( threads, [&]( int t, uint64_t i ) {
+            if( i % 16 == 0 ) concurrent.insert( fresh( t, i ) );
+            else concurrent.exists( key( i * 31 + t ) );
+        } );
+        auto m = run( threads, [&]( int t, uint64_t i ) {
+            if( i % 16 == 0 ) { std::lock_guard<std::mutex> guard{ lock }; locked.insert( fresh( t, i ) ); }
+            else { std::lock_guard<std::mutex> guard{ lock }; locked.exists( key( i * 31 + t ) ); }
+        } );
+        std::cout << std::setw( 7 ) << threads << std::setw( 20 ) << c << std::setw( 14 ) << m << '\n';
+    }
+
+    for( int i = 0; i != preload; ++i )
+        REQUIRE( concurrent.exists( key( i ) ) );
+}
+
+TEST_CASE( "Keys can be scanned in order by prefix and from a bound" ) {
+    Trie<> trie;
+    std::set<std::string> expected;
+    for( auto key : { "car", "card", "care", "cared", "cart", "cat", "do", "dog", "", "c" } ) {
+        trie.insert( key );
+        expected.insert( key );
+    }
+
+    auto collect = []( KeyRange range ) {
+        std::vector<std::string> keys;
+        for( auto key : range ) keys.emplace_back( key );
+        return keys;
+    };
+
+    CHECK( collect( trie.keys() ) == std::vector<std::string>( expected.begin(), expected.end() ) );
+    CHECK( collect( trie.prefixScan( "car" ) ) == std::vector<std::string>{ "car", "card", "care", "cared", "cart" } );
+    CHECK( collect( trie.prefixScan( "ca", 3 ) ) == std::vector<std::string>{ "car", "card", "care" } );
+    CHECK( collect( trie.prefixScan( "cb" ) ).empty() );
+
+    CHECK( trie.countPrefix( "" ) == 10 );
+    CHECK( trie.countPrefix( "ca" ) == 6 );
+    CHECK( trie.countPrefix( "care" ) == 2 );
+    CHECK( trie.countPrefix( "dot" ) == 0 );
+
+    // Bounds agree with std::set for keys in the trie, between them and past them
+    for( auto bound : { "", "c", "ca", "card", "cardz", "carf", "cb", "d", "dog", "dogs", "z" } ) {
+        CHECK( collect( trie.lowerBound( bound ) ) == std::vector<std::string>( expected.lower_bound( bound ), expected.end() ) );
+        CHECK( collect( trie.upperBound( bound ) ) == std::vector<std::string>( expected.upper_bound( bound ), expected.end() ) );
+    }
+
+    trie.erase( "card" );
+    CHECK( trie.countPrefix( "car" ) == 4 );
+    CHECK( collect( trie.lowerBound( "card", 2 ) ) == std::vector<std::string>{ "care", "cared" } );
+}
+
+TEST_CASE( "A trie can be built in one pass from sorted keys" ) {
+    std::vector<std::string> strings;
+    for( int i = 0; i != 20000; ++i ) {
+        strings.push_back( "user:" + std::to_string( i * 7919 % 1000003 ) );
+        strings.push_back( std::string( 1, static_cast<char>( i % 256 ) ) + std::to_string( i % 300 ) );
+    }
+    strings.push_back( "" );
+    strings.push_back( "user:" );
+
+    Trie<> inserted;
+    for( auto& str : strings ) inserted.insert( str );
+
+    // Unsorted with duplicates, on one thread and on several
+    for( unsigned threads : { 1u, 4u } ) {
+        Trie<> built( std::vector<std::string_view>( strings.begin(), strings.end() ), threads );
+
+        CHECK( built.size() == inserted.size() );
+        // Each range reserves its own runs in the arenas, which can leave the end of a chunk unused
+        if( threads == 1 ) CHECK( built.bytesUsed() <= inserted.bytesUsed() );
+        CHECK( std::equal( built.keys().begin(), built.keys().end(), inserted.keys().begin(), inserted.keys().end() ) );
+        CHECK( built.countPrefix( "user:1" ) == inserted.countPrefix( "user:1" ) );
+        CHECK( built.exists( "" ) );
+        CHECK( built.exists( "user:1" ) == inserted.exists( "user:1" ) );
+
+        // The built trie takes changes like any other
+        CHECK( built.insert( "user:" ) == Trie<>::InsertionResult::AlreadyExists );
+        CHECK( built.insert( "user:x" ) == Trie<>::InsertionResult::WasInserted );
+        CHECK( built.erase( "user:0" ) );
+        CHECK( built.exists( "user:0" ) == false );
+        CHECK( built.countPrefix( "user:" ) == inserted.countPrefix( "user:" ) );
+    }
+
+    CHECK( Trie<>( std::vector<std::string_view>{} ).size() == 0 );
+    CHECK( Trie<>( { "only" } ).exists( "only" ) );
+}
+
+// Building a trie key by key against building it in one pass, from sorted and from shuffled keys
+    // Run explicitly with the "[.benchmark]" tag
+TEST_CASE( "Bulk load throughput", "[.benchmark]" ) {
+    constexpr int count = 2000000;
+    std::vector<std::string> strings;
+    for( uint64_t i = 0; i != count; ++i )
+        strings.push_back( "key:" + std::to_string( i * 2654435761u % 100000007 ) );
+    std::sort( strings.begin(), strings.end() );
+
+    std::vector<std::string_view> sorted( strings.begin(), strings.end() );
+    auto shuffled = sorted;
+    std::shuffle( shuffled.begin(), shuffled.end(), std::mt19937{ 42 } );
+
+    auto time = []( auto&& fn ) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        return std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+    };
+
+    std::cout << "                   sorted s  shuffled s  bytes/key\n";
+    Trie<> inserted;
+    auto loop = time( [&] { for( auto key : sorted ) inserted.insert( key ); } );
+    auto loopShuffled = time( [&] { Trie<> trie; for( auto key : shuffled ) trie.insert( key ); } );
+    std::cout << "insert loop      " << std::setw( 10 ) << loop << std::setw( 12 ) << loopShuffled << std::setw( 11 ) << inserted.bytesUsed() / count << '\n';
+
+    for( unsigned threads = 1; threads <= std::max( 1u, std::thread::hardware_concurrency() ); threads *= 2 ) {
+        std::optional<Trie<>> built;
+        auto bulk = time( [&] { built.emplace( sorted, threads ); } );
+        auto bulkShuffled = time( [&] { Trie<> trie( shuffled, threads ); } );
+        std::cout << "bulk, " << std::setw( 2 ) << threads << " threads" << std::setw( 10 ) << bulk << std::setw( 12 ) << bulkShuffled << std::setw( 11 ) << built->bytesUsed() / count << '\n';
+        REQUIRE( built->size() == inserted.size() );
+    }
+}
+
+TEST_CASE( "A frozen trie can be queried in place from a mapped file" ) {
+    std::vector<std::string> strings{ "", "user:", "a\0b", "\xff" };
+    for( int i = 0; i != 50000; ++i )
+        strings.push_back( "user:" + std::to_string( i * 7919 % 1000003 ) );
+    Trie<> trie( std::vector<std::string_view>( strings.begin(), strings.end() ) );
+
+    auto image = trie.freeze();
+    INFO( "image bytes: " << image.size() << ", trie bytes: " << trie.bytesUsed() );
+    CHECK( image.size() * 3 < trie.bytesUsed() );
+
+    auto path = ( std::filesystem::temp_directory_path() / "nash-frozen-trie.bin" ).string();
+    std::ofstream( path, std::ios::binary ).write( image.data(), static_cast<std::streamsize>( image.size() ) );
+    {
+        MappedFile file( path );
+        FrozenTrie frozen( file.bytes() );
+
+        CHECK( frozen.size() == trie.size() );
+        CHECK( std::all_of( strings.begin(), strings.end(), [&]( auto& key ) { return frozen.exists( key ); } ) );
+        for( auto key : { "user", "user:1x", "user:10000000", "a", "\xfe", "zzz" } )
+            CHECK( frozen.exists( key ) == trie.exists( key ) );
+
+        CHECK( std::equal( frozen.keys().begin(), frozen.keys().end(), trie.keys().begin(), trie.keys().end() ) );
+        for( auto prefix : { "user:12", "user:9999", "a", "b", "" } ) {
+            auto frozenKeys = frozen.prefixScan( prefix, 20 );
+            auto keys = trie.prefixScan( prefix, 20 );
+            CHECK( std::equal( frozenKeys.begin(), frozenKeys.end(), keys.begin(), keys.end() ) );
+        }
+    }
+    std::filesystem::remove( path );
+
+    // Only images that look whole are opened
+    auto broken = image;
+    broken[0] = 'X';
+    CHECK_THROWS_AS( FrozenTrie( broken ), std::invalid_argument );
+    CHECK_THROWS_AS( FrozenTrie( std::string_view( image ).substr( 0, image.size() - 8 ) ), std::invalid_argument );
+
+    auto empty = Trie<>{}.freeze();
+    FrozenTrie none( empty );
+    CHECK( none.size() == 0 );
+    CHECK( none.exists( "" ) == false );
+    CHECK( none.keys().begin() == none.keys().end() );
+}
+
+TEST_CASE( "A trie can map strings to values" ) {
+    Trie<int> routes;
+    CHECK( routes.insertOrAssign( "/api/users", 1 ) == InsertionResult::WasInserted );
+    CHECK( routes.insertOrAssign( "/api/user", 2 ) == InsertionResult::WasInserted );
+    CHECK( routes.insertOrAssign( "/api", 3 ) == InsertionResult::WasInserted );
+    CHECK( routes.insertOrAssign( "/api/users", 4 ) == InsertionResult::AlreadyExists );
+
+    CHECK( routes.size() == 3 );
+    REQUIRE( routes.find( "/api/users" ) );
+    CHECK( *routes.find( "/api/users" ) == 4 );
+    CHECK( *routes.find( "/api/user" ) == 2 );
+    CHECK( *routes.find( "/api" ) == 3 );
+    CHECK( routes.find( "/api/use" ) == nullptr );
+    CHECK( routes.find( "/ap" ) == nullptr );
+
+    // Values stay where they are as the map grows
+    auto user = routes.find( "/api/user" );
+    for( int i = 0; i != 10000; ++i )
+        routes.insertOrAssign( "/static/" + std::to_string( i ), i );
+    CHECK( routes.find( "/api/user" ) == user );
+    CHECK( *routes.find( "/static/9999" ) == 9999 );
+
+    // Lookups take views into the caller's string and allocate nothing
+    std::string_view path = "/api/users/42/orders";
+    auto before = g_allocations;
+    size_t hits = 0;
+    for( size_t len = 0; len <= path.size(); ++len ) {
+        hits += routes.find( path.substr( 0, len ) ) != nullptr;
+        hits += routes.exists( path.substr( 0, len ) );
+    }
+    CHECK( g_allocations == before );
+    CHECK( hits == 6 );
+
+    // Erasing a key destroys its value
+    Trie<std::shared_ptr<int>> owners;
+    auto owned = std::make_shared<int>( 1 );
+    owners.insertOrAssign( "key", owned );
+    CHECK( owned.use_count() == 2 );
+    CHECK( owners.erase( "key" ) );
+    CHECK( owned.use_count() == 1 );
+    CHECK( owners.find( "key" ) == nullptr );
+
+    CHECK( routes.erase( "/api/user" ) );
+    CHECK( routes.erase( "/api/user" ) == false );
+    CHECK( routes.find( "/api/user" ) == nullptr );
+    CHECK( *routes.find( "/api/users" ) == 4 );
+    CHECK( routes.size() == 10002 );
+}
+
+// Routing table lookups from views into a request buffer, against std::unordered_map (which needs a std::string key)
+    // Run explicitly with the "[.benchmark]" tag
+TEST_CASE( "Map lookup throughput", "[.benchmark]" ) {
+    auto route = []( uint64_t i ) { return "/api/v2/accounts/" + std::to_string( i * 2654435761u % 100000007 ) + "/orders"; };
+
+    std::cout << " routes      trie ns  unordered_map ns\n";
+    for( uint64_t routes : { 1000, 200000 } ) {
+        Trie<int> trie;
+        std::unordered_map<std::string, int> map;
+        for( uint64_t i = 0; i != routes; ++i ) {
+            trie.insertOrAssign( route( i ), static_cast<int>( i ) );
+            map.emplace( route( i ), static_cast<int>( i ) );
+        }
+
+        // Every other path is a miss
+        std::string buffer;
+        std::vector<std::pair<size_t, size_t>> paths;
+        for( uint64_t i = 0; i != 1000000; ++i ) {
+            auto path = route( i * 7919 % ( 2 * routes ) );
+            paths.emplace_back( buffer.size(), path.size() );
+            buffer += path;
+        }
+
+        auto time = [&]( auto&& lookup ) {
+            uint64_t sum = 0;
+            auto start = std::chrono::steady_clock::now();
+            for( auto [at, size] : paths ) sum += lookup( std::string_view( buffer ).substr( at, size ) );
+            auto ns = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count() / paths.size();
+            return std::make_pair( ns, sum );
+        };
+
+        auto [trieNs, trieSum] = time( [&]( std::string_view path ) { auto v = trie.find( path ); return v ? *v : 0; } );
+        auto [mapNs, mapSum] = time( [&]( std::string_view path ) { auto it = map.find( std::string( path ) ); return it != map.end() ? it->second : 0; } );
+        std::cout << std::setw( 7 ) << routes << std::setw( 13 ) << trieNs << std::setw( 18 ) << mapNs << '\n';
+        REQUIRE( trieSum == mapSum );
+    }
+}
+
+TEST_CASE( "Erasing merges nodes left with a single child" ) {
+    g_allNodes.clear();
+
+    Trie<> trie;
+    for( auto key : { "tea", "team", "ten" } ) trie.insert( key );
+    auto pool = *g_allNodes.begin();
+    CHECK( pool->label( 0 ) == "te" );
+
+    // The root keeps no key and only branches to "tea"
+    CHECK( trie.erase( "ten" ) );
+    CHECK( pool->label( 0 ) == "tea" );
+    CHECK( pool->childCount( 0 ) == 1 );
+
+    CHECK( trie.erase( "tea" ) );
+    CHECK( pool->label( 0 ) == "team" );
+    CHECK( pool->childCount( 0 ) == 0 );
+    CHECK( totalChildNodeSlots() == 0 );
+    CHECK( trie.exists( "team" ) );
+
+    // An emptied root forgets its label, so the next key starts afresh
+    CHECK( trie.erase( "team" ) );
+    CHECK( trie.insert( "x" ) == InsertionResult::WasInserted );
+    CHECK( pool->label( 0 ) == "x" );
+    CHECK( totalChildNodeSlots() == 0 );
 }
 
 TEST_CASE( "Your test cases" ) {
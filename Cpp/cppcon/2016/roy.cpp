@@ -1,34 +1,254 @@
 #include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
 
 constexpr const auto &lorem_ipsum = "Lorem ipsum dolor sit amet, consectetur adipiscing elit. Curabitur eu lorem sed odio varius vestibulum et eu ante. Quisque rutrum, sem vitae accumsan finibus, enim elit mattis urna, gravida rhoncus erat sem quis lectus. Donec ultrices pretium arcu, rhoncus facilisis eros lobortis sit amet. Quisque vitae lorem at ante ultricies pulvinar. Sed suscipit faucibus tempus. Donec ut sem felis. Ut porttitor libero justo, ultrices egestas purus cursus cursus. Fusce et sapien felis. Phasellus ut ornare arcu. Vestibulum eget finibus dui. Sed quam sem, efficitur vitae risus egestas, vehicula vestibulum est. Nulla rutrum tempus mollis. Nunc a elementum felis";
 
 // Use your code below from the previous part as a starting point.
 template<size_t N>
-constexpr auto lorem_len(const char(&)[N]) { return N; }
+constexpr auto lorem_len(const char(&)[N]) { return N - 1; } // without the terminating NUL
+
+constexpr std::string_view lorem_text{ lorem_ipsum, lorem_len(lorem_ipsum) };
+
+// Bytes handed out per bulk write, whole repetitions of the text so every chunk starts at the same offset in it
+constexpr size_t lorem_chunk = (size_t{ 1 } << 16) / lorem_text.size() * lorem_text.size();
+
+// Repetitions of the text built once, lorem_chunk bytes of it can be read from any offset within the first one
+const std::string& lorem_tile() {
+    static const std::string tile = [] {
+        std::string s;
+        while (s.size() < lorem_chunk + lorem_text.size()) s += lorem_text;
+        return s;
+    }();
+    return tile;
+}
 
 class lorem_view { // constexpr string
     private:
         const std::size_t sz_;
+        const std::size_t offset_; // where in the text the view starts
     public:
-        constexpr lorem_view(size_t sz) : sz_{ sz } {}
+        static constexpr std::size_t npos = std::size_t(-1);
+
+        constexpr lorem_view(size_t sz, size_t offset = 0) : sz_{ sz }, offset_{ offset % lorem_text.size() } {}
         constexpr std::size_t size() const { return sz_; } // size()
+        constexpr std::size_t offset() const { return offset_; }
+        constexpr char operator[](size_t i) const { return lorem_text[(offset_ + i % lorem_text.size()) % lorem_text.size()]; }
+
+        // Characters [pos, pos + count) of the view, clamped like std::string_view::substr, nothing is generated
+        constexpr lorem_view substr(size_t pos, size_t count = npos) const {
+            pos = std::min(pos, sz_);
+            return { std::min(count, sz_ - pos), offset_ + pos % lorem_text.size() };
+        }
+
+        // Fill out[0, size()) with the text, a tile-sized memcpy at a time
+        void copy_to(char* out) const {
+            auto start = lorem_tile().data() + offset_;
+            for (size_t done = 0; done < sz_; done += lorem_chunk) std::memcpy(out + done, start, std::min(sz_ - done, lorem_chunk));
+        }
+
+#if defined(__unix__) || defined(__APPLE__)
+        // Write the view to a file descriptor, up to 16 tile-sized chunks per writev, returns false on a write error
+        bool write_to(int fd) const {
+            auto& tile = lorem_tile();
+            for (size_t done = 0; done < sz_; ) {
+                // A short write leaves the next byte anywhere in the text, so the start is worked out again every call
+                auto start = tile.data() + (offset_ + done % lorem_text.size()) % lorem_text.size();
+
+                iovec chunks[16];
+                int count = 0;
+                for (size_t batch = 0; count != 16 && done + batch < sz_; ++count) {
+                    auto len = std::min(sz_ - done - batch, lorem_chunk);
+                    chunks[count] = { const_cast<char*>(start), len };
+                    batch += len;
+                }
+
+                auto written = writev(fd, chunks, count);
+                if (written < 0) {
+                    if (errno == EINTR) continue;
+                    return false;
+                }
+                done += written;
+            }
+            return true;
+        }
+#endif
 };
 
 std::ostream& operator<<(std::ostream& s, const lorem_view& str) {
-    constexpr auto len = lorem_len(lorem_ipsum);
-    for (size_t i = 0; i <= str.size(); ++i) s << lorem_ipsum[i % len];
+    auto start = lorem_tile().data() + str.offset();
+    for (size_t done = 0; done < str.size() && s; done += lorem_chunk) s.write(start, std::min(str.size() - done, lorem_chunk));
     return s;
 }
 
-constexpr lorem_view operator"" _lorem(unsigned long long N) {
+// The first N characters of the text from Offset on, built at compile time
+    // A constexpr lorem_string is plain data in .rodata, and converts to std::string_view and lorem_view for free
+    // GCC's default constexpr budget runs out short of a megabyte of text, lorem_view takes over beyond that
+template<size_t N, size_t Offset = 0>
+struct lorem_string {
+    char chars[N + 1] = {};
+
+    // Lays down one repetition, then copies it forward a repetition at a time, so no loop comes near the
+    // compiler's constexpr loop limit and each character costs a single copy
+    constexpr lorem_string() {
+        constexpr auto len = lorem_text.size();
+        for (size_t j = 0; j != len && j != N; ++j) chars[j] = lorem_ipsum[(Offset + j) % len];
+        for (size_t i = len; i < N; i += len) {
+            for (size_t j = i; j != i + len && j != N; ++j) chars[j] = chars[j - len];
+        }
+    }
+
+    constexpr std::size_t size() const { return N; }
+    constexpr const char* data() const { return chars; }
+    constexpr const char* c_str() const { return chars; }
+    constexpr char operator[](size_t i) const { return chars[i]; }
+
+    constexpr operator std::string_view() const { return { chars, N }; }
+    constexpr lorem_view view() const { return { N, Offset }; }
+};
+
+template<size_t N, size_t Offset>
+std::ostream& operator<<(std::ostream& s, const lorem_string<N, Offset>& str) {
+    return s.write(str.data(), N);
+}
+
+// 64-bit FNV-1a, usable on lorem_strings at compile time
+constexpr uint64_t lorem_hash(std::string_view s) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (auto c : s) h = (h ^ static_cast<unsigned char>(c)) * 0x100000001b3ull;
+    return h;
+}
+
+// `35_lorem` is a lorem_string<35>, the literal's digits are read at compile time
+template<char... Digits>
+constexpr auto operator"" _lorem() {
+    static_assert(((Digits >= '0' && Digits <= '9') && ...), "_lorem takes a decimal size");
+    constexpr auto n = [] {
+        size_t v = 0;
+        ((v = v * 10 + static_cast<size_t>(Digits - '0')), ...);
+        return v;
+    }();
+    return lorem_string<n>{};
+}
+
+// `35_lorem_view` only knows its size and generates the text on output, for sizes too big to build at compile time
+constexpr lorem_view operator"" _lorem_view(unsigned long long N) {
     return lorem_view{ static_cast<size_t>(N) };
 }
 
-int main() {
+#if defined(__unix__) || defined(__APPLE__)
+// Minimal ostream buffer over a file descriptor, the benchmark's stream paths write through it into a pipe
+class fd_streambuf : public std::streambuf {
+    private:
+        int fd_;
+        char buffer_[1 << 16];
+
+        bool flush_buffer() {
+            for (auto p = pbase(); p != pptr(); ) {
+                auto written = write(fd_, p, pptr() - p);
+                if (written < 0 && errno != EINTR) return false;
+                if (written > 0) p += written;
+            }
+            setp(buffer_, buffer_ + sizeof buffer_);
+            return true;
+        }
+
+    protected:
+        int_type overflow(int_type c) override {
+            if (!flush_buffer()) return traits_type::eof();
+            if (!traits_type::eq_int_type(c, traits_type::eof())) sputc(traits_type::to_char_type(c));
+            return traits_type::not_eof(c);
+        }
+
+        int sync() override { return flush_buffer() ? 0 : -1; }
+
+    public:
+        explicit fd_streambuf(int fd) : fd_{ fd } { setp(buffer_, buffer_ + sizeof buffer_); }
+        ~fd_streambuf() override { flush_buffer(); }
+};
+#endif
+
+// Throughput of each output path, with the old character-at-a-time loop and a plain memset for scale
+    // The stream and fd paths write into a pipe that a second thread reads out, so each byte really gets copied
+void benchmark_lorem() {
+    auto time = [](const char* what, size_t bytes, auto&& work) {
+        auto start = std::chrono::steady_clock::now();
+        work();
+        std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+        std::cout << what << ": " << bytes / took.count() / 1e6 << " MB/s\n";
+    };
+
+    constexpr size_t buffer_size = size_t{ 256 } << 20, total = size_t{ 4 } << 30, piped = size_t{ 256 } << 20;
+    std::unique_ptr<char[]> buffer{ new char[buffer_size] };
+
+    time("memset", total, [&] {
+        for (size_t done = 0; done != total; done += buffer_size) std::memset(buffer.get(), 'x', buffer_size);
+    });
+    time("copy_to", total, [&] {
+        for (size_t done = 0; done != total; done += buffer_size) lorem_view{ buffer_size, 17 + done }.copy_to(buffer.get());
+    });
+
+#if defined(__unix__) || defined(__APPLE__)
+    int ends[2];
+    if (pipe(ends) != 0) {
+        std::cerr << "pipe: " << std::strerror(errno) << "\n";
+        return;
+    }
+
+    // Reads until the write end is closed, the writes below can't run ahead of it by more than the pipe's buffer
+    size_t drained = 0;
+    std::thread reader{ [&] {
+        std::unique_ptr<char[]> in{ new char[1 << 16] };
+        for (ssize_t got; (got = read(ends[0], in.get(), 1 << 16)) != 0; ) {
+            if (got > 0) drained += got;
+            else if (errno != EINTR) break;
+        }
+    } };
+
+    {
+        fd_streambuf sink{ ends[1] };
+        std::ostream out{ &sink };
+        // The same byte count for both stream paths, only the way the text reaches the stream differs
+        time("per character <<", piped, [&] {
+            for (size_t i = 0; i != piped; ++i) out << lorem_ipsum[i % lorem_text.size()];
+            out.flush();
+        });
+        time("bulk <<", piped, [&] { out << lorem_view{ piped, 17 } << std::flush; });
+    }
+    time("write_to", piped, [&] { lorem_view{ piped, 17 }.write_to(ends[1]); });
+
+    close(ends[1]);
+    reader.join();
+    close(ends[0]);
+    if (drained != 3 * piped) std::cerr << "pipe reader got " << drained << " of " << 3 * piped << " bytes\n";
+#endif
+}
+
+int main(int argc, char** argv) {
+   if (argc > 1 && std::string_view{ argv[1] } == "--benchmark") {
+       benchmark_lorem();
+       return 0;
+   }
+
    constexpr auto text = 35_lorem;
    static_assert(text.size() == 35);
-   
+   static_assert(std::string_view{ text } == "Lorem ipsum dolor sit amet, consect");
+   static_assert(lorem_hash(text) == 0x572fe170fdd51310ull);
+   static_assert(lorem_string<5, 6>{}[0] == 'i' && std::string_view{ lorem_string<5, 6>{} } == "ipsum");
+
    std::cout << text << std::endl;
-}
\ No newline at end of file
+}
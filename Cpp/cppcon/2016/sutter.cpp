@@ -1,31 +1,135 @@
 #include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
 #include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <set>
+#include <string>
+#include <string_view>
 #include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Folding works 16 bytes at a time with SSE2 (always there on x86-64) and 8 bytes at a time everywhere else
+#if defined(__x86_64__) || defined(_M_X64)
+#define CI_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// Case folding is ASCII-only, other bytes compare as themselves (as unsigned chars)
+    // std::tolower depended on the locale and was undefined for negative chars
+inline unsigned char ci_fold(char c) {
+    auto u = static_cast<unsigned char>(c);
+    return static_cast<unsigned>(u - 'A') < 26 ? u | 0x20 : u;
+}
+
+// Fold the 8 bytes of a word at once: a byte is upper case when adding 0x80 - 'A' sets its top bit and adding 0x80 - 'Z' - 1 doesn't
+    // The top bits are cleared first so no byte carries into the next, bytes >= 0x80 are left alone
+inline uint64_t ci_fold8(uint64_t x) {
+    constexpr uint64_t ones = 0x0101010101010101ull, high = 0x8080808080808080ull;
+    auto low = x & ~high;
+    auto upper = ((low + (0x80 - 'A') * ones) ^ (low + (0x80 - 'Z' - 1) * ones)) & ~x & high;
+    return x | (upper >> 2);
+}
+
+// Up to 8 bytes as a zero-padded word
+inline uint64_t ci_load8(const char* p, size_t n = 8) {
+    uint64_t x = 0;
+    std::memcpy(&x, p, n);
+    return x;
+}
+
+#ifdef CI_SSE2
+inline __m128i ci_fold16(const char* p) {
+    auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    auto upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+    return _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+// Bit i is set when byte i of the folded blocks differs
+inline unsigned ci_diff16(const char* lhs, const char* rhs) {
+    return ~_mm_movemask_epi8(_mm_cmpeq_epi8(ci_fold16(lhs), ci_fold16(rhs))) & 0xFFFF;
+}
+#endif
+
+// Length of the common prefix of two strings of at least n bytes, ignoring case
+inline size_t ci_mismatch(const char* lhs, const char* rhs, size_t n) {
+    size_t i = 0;
+#ifdef CI_SSE2
+    for (; i + 16 <= n; i += 16) {
+        if (auto diff = ci_diff16(lhs + i, rhs + i)) {
+#ifdef _MSC_VER
+            unsigned long bit;
+            _BitScanForward(&bit, diff);
+            return i + bit;
+#else
+            return i + __builtin_ctz(diff);
+#endif
+        }
+    }
+#endif
+    for (; i + 8 <= n; i += 8) {
+        if (ci_fold8(ci_load8(lhs + i)) != ci_fold8(ci_load8(rhs + i))) break;
+    }
+    while (i != n && ci_fold(lhs[i]) == ci_fold(rhs[i])) ++i;
+    return i;
+}
+
+// Three-way case-insensitive compare, a proper prefix sorts first
+int ci_compare(std::string_view lhs, std::string_view rhs) {
+    auto n = std::min(lhs.size(), rhs.size());
+    auto i = ci_mismatch(lhs.data(), rhs.data(), n);
+    if (i != n) return ci_fold(lhs[i]) < ci_fold(rhs[i]) ? -1 : 1;
+    return (lhs.size() > rhs.size()) - (lhs.size() < rhs.size());
+}
+
+bool ci_equal(std::string_view lhs, std::string_view rhs) {
+    return lhs.size() == rhs.size() && ci_mismatch(lhs.data(), rhs.data(), lhs.size()) == lhs.size();
+}
+
+// Multiply-xorshift hash over the folded bytes, 8 at a time, so strings that are ci_equal hash the same
+size_t ci_hash(std::string_view s) {
+    constexpr uint64_t k = 0x9E3779B97F4A7C15ull;
+    auto mix = [&](uint64_t h, uint64_t x) {
+        h = (h ^ x) * k;
+        return h ^ (h >> 32);
+    };
+
+    uint64_t h = s.size() * k;
+    size_t i = 0;
+    for (; i + 8 <= s.size(); i += 8) h = mix(h, ci_fold8(ci_load8(s.data() + i)));
+    if (i != s.size()) h = mix(h, ci_fold8(ci_load8(s.data() + i, s.size() - i)));
+    return static_cast<size_t>(mix(h, 0));
+}
 
 class CIString {
     std::string internal;
-    
+
     public:
         template<class S, class=std::enable_if_t<std::is_constructible_v<std::string, S>>>
-        CIString(S in) : internal{ in } {}
-        
+        CIString(S&& in) : internal( std::forward<S>(in) ) {}
+
+        std::string_view view() const { return internal; }
+
         friend bool operator<(const CIString&, const CIString&);
+        friend bool operator==(const CIString&, const CIString&);
 };
 
 // Could use `operator<=>` here to simplify it further
 bool operator<(const CIString& lhs, const CIString& rhs) {
-    for (auto i=0; i != lhs.internal.size(); ++i) {
-        auto lchar = std::tolower(lhs.internal[i]),
-             rchar = std::tolower(rhs.internal[i]);
-             
-        if (lchar < rchar) return true;
-        if (lchar > rchar) return false;
-    }
-    
-    return lhs.internal.size() < rhs.internal.size();
+    return ci_compare(lhs.internal, rhs.internal) < 0;
 }
 bool operator==(const CIString& lhs, const CIString& rhs) {
-    return !(lhs < rhs) && !(rhs < lhs);
+    return ci_equal(lhs.internal, rhs.internal);
 }
 bool operator!=(const CIString& lhs, const CIString& rhs) {
     return !(lhs == rhs);
@@ -38,4 +142,272 @@ bool operator>(const CIString& lhs, const CIString& rhs) {
 }
 bool operator>=(const CIString& lhs, const CIString& rhs) {
     return rhs <= lhs;
-}
\ No newline at end of file
+}
+
+// Handle to a string interned in a CIPool, as big as a pointer
+    // The pool keeps one case-folded copy and its hash per spelling, so handles from the same pool are equal
+    // exactly when their pointers are, the empty string is the null handle
+class InternedCIString {
+    public:
+        struct Entry {
+            const char* folded;
+            size_t size;
+            size_t hash;
+        };
+
+    private:
+        const Entry* entry = nullptr;
+
+    public:
+        InternedCIString() = default;
+        explicit InternedCIString(const Entry* entry) : entry{ entry } {}
+
+        // The folded (lower case) bytes
+        std::string_view view() const { return entry ? std::string_view{ entry->folded, entry->size } : std::string_view{}; }
+        size_t hash() const { return entry ? entry->hash : ci_hash({}); }
+
+        friend bool operator==(InternedCIString lhs, InternedCIString rhs) { return lhs.entry == rhs.entry; }
+        friend bool operator!=(InternedCIString lhs, InternedCIString rhs) { return lhs.entry != rhs.entry; }
+        friend bool operator<(InternedCIString lhs, InternedCIString rhs) {
+            return lhs.entry != rhs.entry && ci_compare(lhs.view(), rhs.view()) < 0;
+        }
+};
+
+// Arena of interned strings with an open-addressing index on their hashes
+    // Entries and bytes are never freed or moved while the pool lives, handles stay valid until then
+    // Lookups and interning take a lock, so one pool can be shared by every parsing thread
+class CIPool {
+    using Entry = InternedCIString::Entry;
+
+    static constexpr size_t block_size = 1 << 16;
+
+    mutable std::mutex mutex;
+    std::deque<Entry> entries;
+    std::vector<const Entry*> index;    // Power-of-two table kept at most half full, nullptr is empty
+    std::vector<std::unique_ptr<char[]>> blocks;
+    std::vector<std::unique_ptr<char[]>> large;     // Strings too big to share a block
+    size_t used = block_size;                       // Bytes used in the last block
+
+    // Folded copy of s that lives as long as the pool
+    const char* store(std::string_view s) {
+        char* out;
+        if (s.size() > block_size / 4) out = large.emplace_back(new char[s.size()]).get();
+        else {
+            if (used + s.size() > block_size) {
+                blocks.emplace_back(new char[block_size]);
+                used = 0;
+            }
+            out = blocks.back().get() + used;
+            used += s.size();
+        }
+        std::transform(s.begin(), s.end(), out, ci_fold);
+        return out;
+    }
+
+    void grow() {
+        std::vector<const Entry*> old(std::max<size_t>(64, 2 * index.size()));
+        old.swap(index);
+        auto mask = index.size() - 1;
+        for (auto e : old) {
+            if (!e) continue;
+            auto i = e->hash & mask;
+            while (index[i]) i = (i + 1) & mask;
+            index[i] = e;
+        }
+    }
+
+    // Position of s in the index, or of the empty slot it would go in
+    size_t position(std::string_view s, size_t hash) const {
+        auto mask = index.size() - 1;
+        for (auto i = hash & mask; ; i = (i + 1) & mask) {
+            auto e = index[i];
+            if (!e || (e->hash == hash && ci_equal({ e->folded, e->size }, s))) return i;
+        }
+    }
+
+    public:
+        CIPool() = default;
+        CIPool(const CIPool&) = delete;
+        CIPool& operator=(const CIPool&) = delete;
+
+        // Handle for s, adding it to the pool the first time any spelling of it is seen
+        InternedCIString intern(std::string_view s) {
+            if (s.empty()) return {};
+
+            auto hash = ci_hash(s);
+            std::lock_guard<std::mutex> lock{ mutex };
+            if (2 * (entries.size() + 1) > index.size()) grow();
+
+            auto& e = index[position(s, hash)];
+            if (!e) e = &entries.emplace_back(Entry{ store(s), s.size(), hash });
+            return InternedCIString{ e };
+        }
+
+        // Handle for s if it has been interned, never allocates
+        std::optional<InternedCIString> find(std::string_view s) const {
+            if (s.empty()) return InternedCIString{};
+
+            auto hash = ci_hash(s);
+            std::lock_guard<std::mutex> lock{ mutex };
+            if (index.empty()) return std::nullopt;
+
+            auto e = index[position(s, hash)];
+            if (!e) return std::nullopt;
+            return InternedCIString{ e };
+        }
+
+        size_t size() const {
+            std::lock_guard<std::mutex> lock{ mutex };
+            return entries.size();
+        }
+};
+
+// Bytes of anything the comparators below accept (one template, since CIString converts from strings too)
+template<class S>
+std::string_view ci_view(const S& s) {
+    if constexpr (std::is_same_v<S, CIString> || std::is_same_v<S, InternedCIString>) return s.view();
+    else return std::string_view{ s };
+}
+
+// Case-insensitive ordering, equality and hashing over CIString, InternedCIString and anything that converts to
+    // std::string_view. They are transparent, so std::set<CIString, CILess>::find("host") doesn't build a CIString
+    // (unordered containers use CIHash and CIEqual the same way from C++20)
+struct CILess {
+    using is_transparent = void;
+
+    template<class L, class R>
+    bool operator()(const L& lhs, const R& rhs) const { return ci_compare(ci_view(lhs), ci_view(rhs)) < 0; }
+};
+
+struct CIEqual {
+    using is_transparent = void;
+
+    bool operator()(InternedCIString lhs, InternedCIString rhs) const { return lhs == rhs; }
+    template<class L, class R>
+    bool operator()(const L& lhs, const R& rhs) const { return ci_equal(ci_view(lhs), ci_view(rhs)); }
+};
+
+struct CIHash {
+    using is_transparent = void;
+
+    size_t operator()(InternedCIString s) const { return s.hash(); }
+    template<class S>
+    size_t operator()(const S& s) const { return ci_hash(ci_view(s)); }
+};
+
+namespace std {
+    template<>
+    struct hash<CIString> {
+        size_t operator()(const CIString& s) const { return ci_hash(s.view()); }
+    };
+
+    template<>
+    struct hash<InternedCIString> {
+        size_t operator()(InternedCIString s) const { return s.hash(); }
+    };
+}
+
+
+// The byte-at-a-time `operator<` this file used to have (minus its read past the end of rhs), to benchmark against
+bool tolower_less(std::string_view lhs, std::string_view rhs) {
+    for (size_t i = 0; i != std::min(lhs.size(), rhs.size()); ++i) {
+        auto lchar = std::tolower(lhs[i]),
+             rchar = std::tolower(rhs[i]);
+
+        if (lchar < rchar) return true;
+        if (lchar > rchar) return false;
+    }
+
+    return lhs.size() < rhs.size();
+}
+
+// Sort header names, then look each one up in a std::map and (with the new hash) a std::unordered_map
+int main() {
+    const char* names[] = { "Content-Type", "Content-Length", "Accept-Encoding", "X-Forwarded-For", "Cache-Control",
+                            "Authorization", "User-Agent", "Access-Control-Allow-Origin", "Strict-Transport-Security" };
+    std::mt19937 rng{ 42 };
+    std::vector<std::string> keys;
+    for (size_t i = 0; i != 200000; ++i) {
+        std::string key = names[i % std::size(names)];
+        key += "-" + std::to_string(rng() % 100000);
+        for (auto& c : key) if (rng() % 2) c = static_cast<char>(std::toupper(c));
+        keys.push_back(std::move(key));
+    }
+
+    auto time = [](const char* what, auto&& work) {
+        auto start = std::chrono::steady_clock::now();
+        auto result = work();
+        std::chrono::duration<double, std::milli> took = std::chrono::steady_clock::now() - start;
+        std::cout << what << ": " << took.count() << " ms (" << result << ")\n";
+    };
+
+    time("sort, tolower", [&] {
+        auto v = keys;
+        std::sort(v.begin(), v.end(), tolower_less);
+        return v.front();
+    });
+    time("sort, ci_compare", [&] {
+        std::vector<CIString> v(keys.begin(), keys.end());
+        std::sort(v.begin(), v.end());
+        return std::string{ v.front().view() };
+    });
+
+    auto tolower_map = [&] {
+        std::map<std::string, int, decltype(&tolower_less)> m{ tolower_less };
+        for (auto& k : keys) ++m[k];
+        return m;
+    }();
+    std::map<CIString, int> ci_map;
+    std::unordered_map<CIString, int> ci_hash_map;
+    for (auto& k : keys) ++ci_map[k], ++ci_hash_map[k];
+
+    time("std::map lookups, tolower", [&] {
+        size_t hits = 0;
+        for (auto& k : keys) hits += tolower_map.count(k);
+        return hits;
+    });
+    std::vector<CIString> lookups(keys.begin(), keys.end());
+    time("std::map lookups, ci_compare", [&] {
+        size_t hits = 0;
+        for (auto& k : lookups) hits += ci_map.count(k);
+        return hits;
+    });
+    time("std::unordered_map lookups, ci_hash", [&] {
+        size_t hits = 0;
+        for (auto& k : lookups) hits += ci_hash_map.count(k);
+        return hits;
+    });
+
+    // Lookups by string_view, which used to need a temporary CIString
+    std::vector<std::string_view> views(keys.begin(), keys.end());
+    std::set<CIString> ci_set(keys.begin(), keys.end());
+    std::set<CIString, CILess> transparent_set(keys.begin(), keys.end());
+    time("std::set string_view lookups, temporary CIString", [&] {
+        size_t hits = 0;
+        for (auto k : views) hits += ci_set.count(CIString{ k });
+        return hits;
+    });
+    time("std::set string_view lookups, CILess", [&] {
+        size_t hits = 0;
+        for (auto k : views) hits += transparent_set.count(k);
+        return hits;
+    });
+
+    CIPool pool;
+    std::vector<InternedCIString> interned;
+    time("intern", [&] {
+        for (auto k : views) interned.push_back(pool.intern(k));
+        return pool.size();
+    });
+    std::unordered_set<InternedCIString> interned_set(interned.begin(), interned.end());
+    time("std::unordered_set lookups, interned", [&] {
+        size_t hits = 0;
+        for (auto k : interned) hits += interned_set.count(k);
+        return hits;
+    });
+    time("CIPool::find lookups", [&] {
+        size_t hits = 0;
+        for (auto k : views) hits += pool.find(k).has_value();
+        return hits;
+    });
+}
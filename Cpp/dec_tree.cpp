@@ -2,6 +2,10 @@
 #include <sstream>
 #include <iterator>
 
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
 #include <algorithm>
 #include <numeric>
 #include <cmath>
@@ -9,29 +13,491 @@
 #include <iostream>
 #include <iomanip>
 
+#include <array>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
+#include <deque>
 #include <unordered_map>
 
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Vector kernels are compiled per instruction set and picked at runtime (see `kernels()`)
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define DT_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define DT_TARGET(isa)
+#else
+#define DT_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
 // Helper typedefs
 template<class T>
 using Vec = std::vector<T>;
 template<class K, class V>
 using Map = std::unordered_map<K, V>;
 
+// Allocation counting replaces the global operator new, so it's only built with -DDEC_TREE_COUNT_ALLOCS
+    // Without it, allocationCount() is always 0 and the counts in traces and benchmarks stay 0
+#ifdef DEC_TREE_COUNT_ALLOCS
+constexpr bool counting_allocations = true;
 
-// Simple struct representing a single example
-struct Example {
-    char classification;
-    Vec<char> attributes;
+// Number of heap allocations made by the current thread (read before and after a piece of work)
+static thread_local size_t thread_allocations = 0;
+
+// Count every allocation on its way to malloc, deallocation is left as is
+void* operator new(size_t size) {
+    ++thread_allocations;
+    if (auto ptr = std::malloc(size ? size : 1)) return ptr;
+    throw std::bad_alloc{};
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    ++thread_allocations;
+    return std::malloc(size ? size : 1);
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+
+size_t allocationCount() { return thread_allocations; }
+#else
+constexpr bool counting_allocations = false;
+
+constexpr size_t allocationCount() { return 0; }
+#endif
+
+// Time and allocations spent running other tasks (see TaskPool::help)
+struct HelpedWork {
+    double micros = 0;
+    size_t allocations = 0;
+};
+
+// Work-stealing task pool
+    // Every worker pushes and pops its own tasks at the back of its queue and steals from the front of the others
+    // The thread that creates the pool acts as worker 0 and runs tasks whenever it waits on a TaskGroup
+class TaskPool {
+    struct Queue {
+        std::mutex lock;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    Vec<Queue> queues;
+    Vec<std::thread> workers;
+
+    std::mutex sleep_lock;
+    std::condition_variable wake;
+    std::atomic<size_t> pending{ 0 };
+    bool done = false;
+
+    inline static thread_local const TaskPool* current = nullptr;
+    inline static thread_local size_t current_id = 0;
+
+    public:
+        // Work this thread did for unrelated tasks while waiting on a TaskGroup, only measured while `measure_help` is set
+            // Lets a caller that times itself across a wait leave out the tasks it helped with in the meantime
+        inline static thread_local HelpedWork help{};
+        inline static thread_local bool measure_help = false;
+
+    private:
+
+    // Take a task from our own queue, or steal one from another worker's queue
+    bool pop(size_t id, std::function<void()>& task) {
+        for (size_t i{}; i != queues.size(); ++i) {
+            auto& q = queues[(id + i) % queues.size()];
+            std::lock_guard<std::mutex> guard{ q.lock };
+            if (q.tasks.empty()) continue;
+
+            if (i == 0) {
+                task = std::move(q.tasks.back());
+                q.tasks.pop_back();
+            } else {
+                task = std::move(q.tasks.front());
+                q.tasks.pop_front();
+            }
+
+            --pending;
+            return true;
+        }
+
+        return false;
+    }
+
+    void loop(size_t id) {
+        current = this;
+        current_id = id;
+
+        std::function<void()> task;
+        while (true) {
+            if (pop(id, task)) {
+                task();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> guard{ sleep_lock };
+            wake.wait(guard, [this] { return done || pending; });
+            if (done) return;
+        }
+    }
+
+    public:
+        explicit TaskPool(size_t threads) : queues(std::max<size_t>(threads, 1)) {
+            current = this;
+            current_id = 0;
+
+            for (size_t i{1}; i < queues.size(); ++i)
+                workers.emplace_back(&TaskPool::loop, this, i);
+        }
+
+        ~TaskPool() {
+            {
+                std::lock_guard<std::mutex> guard{ sleep_lock };
+                done = true;
+            }
+
+            wake.notify_all();
+            for (auto& w : workers) w.join();
+        }
+
+        size_t size() const { return queues.size(); }
+
+        // Get the index of the calling worker
+        size_t worker() const { return current == this ? current_id : 0; }
+
+        void push(std::function<void()> task) {
+            auto& q = queues[worker()];
+            {
+                std::lock_guard<std::mutex> guard{ q.lock };
+                q.tasks.push_back(std::move(task));
+            }
+            {
+                std::lock_guard<std::mutex> guard{ sleep_lock };
+                ++pending;
+            }
+
+            wake.notify_one();
+        }
+
+        // Run one queued task on the calling thread, returns false if there was nothing to run
+        bool runOne() {
+            std::function<void()> task;
+            if (!pop(worker(), task)) return false;
+
+            task();
+            return true;
+        }
+};
+
+// Set of tasks that can be waited on together
+class TaskGroup {
+    TaskPool& pool;
+    std::atomic<size_t> running{ 0 };
+
+    public:
+        explicit TaskGroup(TaskPool& pool) : pool{ pool } {}
+        ~TaskGroup() { wait(); }
+
+        template <class F>
+        void run(F&& fn) {
+            ++running;
+            pool.push([this, fn=std::forward<F>(fn)]() mutable {
+                fn();
+                --running;
+            });
+        }
+
+        // Wait for all tasks in the group, helping out with queued work in the meantime
+            // With TaskPool::measure_help set, the time and allocations of every task run here are added to TaskPool::help
+        void wait() {
+            while (running) {
+                if (!TaskPool::measure_help) {
+                    if (!pool.runOne()) std::this_thread::yield();
+                    continue;
+                }
+
+                // Whatever a helped task measured for itself is part of its total already, so that is dropped
+                auto saved = TaskPool::help;
+                auto allocations = allocationCount();
+                auto start = std::chrono::steady_clock::now();
+                if (!pool.runOne()) {
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                std::chrono::duration<double, std::micro> took = std::chrono::steady_clock::now() - start;
+                TaskPool::help = { saved.micros + took.count(), saved.allocations + (allocationCount() - allocations) };
+            }
+        }
+};
+
+// Per-worker cache of reusable scratch objects
+    // Each worker only touches its own list, so acquiring and releasing never locks
+template <class T>
+class Scratch {
+    TaskPool& pool;
+    std::function<std::unique_ptr<T>()> make;
+    Vec<Vec<std::unique_ptr<T>>> free;
+
+    public:
+        class Lease {
+            Scratch& owner;
+            std::unique_ptr<T> obj;
+
+            public:
+                Lease(Scratch& owner, std::unique_ptr<T> obj) : owner{ owner }, obj{ std::move(obj) } {}
+                Lease(const Lease&) = delete;
+                ~Lease() { owner.free[owner.pool.worker()].push_back(std::move(obj)); }
+
+                T& operator*() { return *obj; }
+                T* operator->() { return obj.get(); }
+        };
+
+        Scratch(TaskPool& pool, std::function<std::unique_ptr<T>()> make)
+            : pool{ pool }, make{ std::move(make) }, free(pool.size()) {}
+
+        Lease acquire() {
+            auto& list = free[pool.worker()];
+            if (list.empty()) return { *this, make() };
+
+            auto obj = std::move(list.back());
+            list.pop_back();
+            return { *this, std::move(obj) };
+        }
+};
+
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+    const char* ptr = nullptr;
+    size_t len = 0;
+
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE, mapping = nullptr;
+#endif
+
+    void release() {
+#ifdef _WIN32
+        if (ptr) UnmapViewOfFile(ptr);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+        if (ptr) munmap(const_cast<char*>(ptr), len);
+#endif
+    }
 
-    Example(const std::string& line) : classification{ line[0] } {
-        size_t idx = 2;
-        while (idx < line.size()) {
-            attributes.push_back(line[idx]);
-            idx += 2;
+    void swap(MappedFile& o) {
+        std::swap(ptr, o.ptr);
+        std::swap(len, o.len);
+#ifdef _WIN32
+        std::swap(file, o.file);
+        std::swap(mapping, o.mapping);
+#endif
+    }
+
+    public:
+        MappedFile() = default;
+
+        explicit MappedFile(const std::string& path) {
+#ifdef _WIN32
+            file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE) return;
+
+            LARGE_INTEGER siz;
+            if (!GetFileSizeEx(file, &siz) || !siz.QuadPart) return;
+
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (!mapping) return;
+
+            ptr = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            if (ptr) len = static_cast<size_t>(siz.QuadPart);
+#else
+            auto fd = open(path.c_str(), O_RDONLY);
+            if (fd == -1) return;
+
+            struct stat st;
+            if (fstat(fd, &st) == 0 && st.st_size > 0) {
+                auto addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (addr != MAP_FAILED) {
+                    ptr = static_cast<const char*>(addr);
+                    len = st.st_size;
+                    madvise(addr, len, MADV_SEQUENTIAL);
+                }
+            }
+
+            close(fd);
+#endif
+        }
+
+        MappedFile(MappedFile&& o) { swap(o); }
+        MappedFile& operator=(MappedFile&& o) {
+            MappedFile tmp{ std::move(o) };
+            swap(tmp);
+            return *this;
         }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        ~MappedFile() { release(); }
+
+        const char* data() const { return ptr; }
+        size_t size() const { return len; }
+        explicit operator bool() const { return ptr; }
+};
+
+// Dictionary-encoded column of single-char values
+    // Codes are packed two to a byte until the dictionary outgrows 4 bits, then stored one per byte
+class Column {
+    Vec<uint8_t> data;
+    Vec<char> dict;
+    std::array<uint16_t, 256> lookup{};         // value -> code + 1 (0 marks an unseen value)
+    size_t len = 0;
+    bool wide = false;
+
+    // Repack the column with 8-bit codes
+    void widen() {
+        Vec<uint8_t> bytes(len);
+        for (size_t i{}; i != len; ++i) bytes[i] = (*this)[i];
+
+        data.swap(bytes);
+        wide = true;
     }
+
+    public:
+        // Get the code stored in the given row
+        uint8_t operator[](size_t row) const {
+            return wide ? data[row] : (data[row >> 1] >> ((row & 1) << 2)) & 0xF;
+        }
+
+        // Get the value that the given code stands for
+        char value(uint8_t code) const { return dict[code]; }
+
+        // Get the code for the given value (-1 if the value never appears in the column)
+        int code(char val) const { return int(lookup[static_cast<unsigned char>(val)]) - 1; }
+
+        size_t size() const { return len; }
+        size_t cardinality() const { return dict.size(); }
+        unsigned bits() const { return wide ? 8 : 4; }
+
+        void reserve(size_t n) { data.reserve(wide ? n : (n + 1) / 2); }
+
+        void push_back(char val) {
+            auto& entry = lookup[static_cast<unsigned char>(val)];
+            if (!entry) {
+                dict.push_back(val);
+                entry = static_cast<uint16_t>(dict.size());
+                if (!wide && dict.size() > 16) widen();
+            }
+
+            auto code = static_cast<uint8_t>(entry - 1);
+            if (wide || !(len & 1))
+                data.push_back(code);
+            else
+                data.back() |= code << 4;
+
+            ++len;
+        }
+
+        // Append the value found at `offset` in each of the given lines
+        void append(const char* const* lines, size_t n, size_t offset) {
+            // Extend the dictionary up front, so the packing loops never have to repack
+            for (size_t i{}; i != n; ++i) {
+                auto val = lines[i][offset];
+                if (!lookup[static_cast<unsigned char>(val)]) {
+                    dict.push_back(val);
+                    lookup[static_cast<unsigned char>(val)] = static_cast<uint16_t>(dict.size());
+                    if (!wide && dict.size() > 16) widen();
+                }
+            }
+
+            auto code = [&](size_t i) { return static_cast<uint8_t>(lookup[static_cast<unsigned char>(lines[i][offset])] - 1); };
+            if (wide) {
+                data.resize(len + n);
+                for (size_t i{}; i != n; ++i) data[len + i] = code(i);
+            } else {
+                data.resize((len + n + 1) / 2);
+
+                // Finish off a half-filled byte, then write whole bytes
+                size_t i{};
+                if (len & 1) data[len >> 1] |= code(i++) << 4;
+
+                auto out = data.data() + ((len + i) >> 1);
+                for (; i + 1 < n; i += 2) *out++ = code(i) | (code(i + 1) << 4);
+                if (i != n) *out = code(i);
+            }
+
+            len += n;
+        }
+};
+
+// Attribute-major storage for all examples (one column per attribute plus the classifications)
+class ExampleStore {
+    Column classes;
+    Vec<Column> attrs;
+
+    public:
+        size_t size() const { return classes.size(); }
+        size_t attributes() const { return attrs.size(); }
+
+        const Column& column(size_t attr) const { return attrs[attr]; }
+        const Column& classifications() const { return classes; }
+
+        // Get the code of the example's classification/attribute value
+        uint8_t classification(size_t ex) const { return classes[ex]; }
+        uint8_t attribute(size_t ex, size_t attr) const { return attrs[attr][ex]; }
+
+        // Make room for the given number of examples
+        void reserve(size_t rows, size_t num_attrs) {
+            if (size() == 0) attrs.resize(num_attrs);
+
+            classes.reserve(rows);
+            for (auto& col : attrs) col.reserve(rows);
+        }
+
+        // Add an example from a line of the form "c,a,a,...,a"
+            // Returns false (and stores nothing) if the line doesn't match the existing examples
+        bool push_back(const char* line, size_t len) {
+            if (!len) return false;
+
+            auto num_attrs = len / 2;
+            if (size() == 0) attrs.resize(num_attrs);
+            if (num_attrs != attrs.size()) return false;
+
+            classes.push_back(line[0]);
+            for (size_t i{}; i != num_attrs; ++i)
+                attrs[i].push_back(line[2 * i + 2]);
+
+            return true;
+        }
+
+        bool push_back(const std::string& line) { return push_back(line.data(), line.size()); }
+
+        // Add a block of lines that are already known to match the existing examples
+            // Fills one column at a time, so each column's writes stay sequential
+        void append(const char* const* lines, size_t n) {
+            classes.append(lines, n, 0);
+            for (size_t i{}; i != attrs.size(); ++i)
+                attrs[i].append(lines, n, 2 * i + 2);
+        }
 };
 
 // Enumeration specifying the different error metrics
@@ -40,6 +506,18 @@ enum class ErrorMetric {
     PROB_ERROR
 };
 
+// Enumeration specifying how the trees of a forest are combined
+enum class Vote {
+    MAJORITY,
+    PROBABILITY
+};
+
+// Enumeration specifying the output format of a training trace
+enum class TraceFormat {
+    CHROME,
+    JSON
+};
+
 // Static mapping of the decision numbers to their names
 static std::vector<std::string> attr_names {
     "cap-shape",
@@ -66,238 +544,1903 @@ static std::vector<std::string> attr_names {
     "habitat"
 };
 
-// Return the "maximal" classification of the chosen range
-std::pair<const char, size_t> maxClass(const Vec<size_t>& idxs, const Vec<Example>& exs) {
-    // Record the classification of all examples
-    Map<char, size_t> count;
-    for (auto i : idxs) count[exs[i].classification]++;
+// Natural logarithm of the mantissa m in [sqrt(1/2), sqrt(2)), an odd series in s = (m - 1) / (m + 1) (2 * atanh(s))
+    // Coefficients are 2 / (2k + 1), |s| < 0.172 so eleven terms are accurate to about one ulp
+constexpr double log_series[] = {
+    2.0, 2.0 / 3, 2.0 / 5, 2.0 / 7, 2.0 / 9, 2.0 / 11, 2.0 / 13, 2.0 / 15, 2.0 / 17, 2.0 / 19, 2.0 / 21
+};
+constexpr double log2_e = 1.4426950408889634;
+constexpr double sqrt_2 = 1.4142135623730951;
 
-    // Find out which result is the "biggest"
-    auto max = std::max_element(std::begin(count), std::end(count),
-        [](std::pair<const char, size_t>& p1, std::pair<const char, size_t>& p2) { return p1.second < p2.second; });
+// Base 2 logarithm of a positive, normal double, split into its exponent and mantissa
+    // The vector kernels run exactly these operations lane by lane
+double seriesLog2(double x) {
+    uint64_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
 
-    return *max;
-}
+    // The biased exponent is turned into a double by putting it below the mantissa of 2^52
+    uint64_t exp_bits = (bits >> 52) | 0x4330000000000000ull;
+    uint64_t man_bits = (bits & 0x000FFFFFFFFFFFFFull) | 0x3FF0000000000000ull;
+    double e, m;
+    std::memcpy(&e, &exp_bits, sizeof(e));
+    std::memcpy(&m, &man_bits, sizeof(m));
+    e -= 4503599627371519.0;                    // 2^52 + 1023
 
-// Count the number of "wrongly" classified examples assuming a majority decision
-double countMinorities(const Vec<size_t>& idxs, const Vec<Example>& exs) {
-    Map<char, size_t> count;
-    for (auto i : idxs) count[exs[i].classification]++;
+    if (m > sqrt_2) {
+        m *= 0.5;
+        e += 1;
+    }
 
-    // Find out which result is the "biggest"
-    auto max = std::max_element(std::begin(count), std::end(count),
-        [](std::pair<const char, size_t>& p1, std::pair<const char, size_t>& p2) { return p1.second < p2.second; });
+    auto s = (m - 1) / (m + 1);
+    auto z = s * s;
+    auto poly = log_series[10];
+    for (int k{9}; k >= 0; --k) poly = poly * z + log_series[k];
 
-    return *max;
+    return e + s * poly * log2_e;
 }
 
-// Count the number of "wrongly" classified examples assuming a majority decision
-double countMinorities(const Vec<size_t>& idxs, const Vec<Example>& exs) {
-    return idxs.size() - maxClass(idxs, exs).second;
+// Count the byte codes in [0, card) found in `codes`, adding to `out`
+void countCodesScalar(const uint8_t* codes, size_t n, size_t, uint32_t* out) {
+    for (size_t i{}; i != n; ++i) out[codes[i]]++;
 }
 
-// Compute the error number for the examples using the 'entropy' calculation metric
-double entropy(const Vec<size_t>& idxs, const Vec<Example>& exs) {
-    // Determine the percentage of "correctly" classified examples
-    auto pos = maxClass(idxs, exs).second / double{ idxs.size() };
+// Weighted entropy term of every histogram cell with `sums[i]` examples, `maxes[i]` of them in the majority class
+    // Matches the per-value accumulation of computeError, cells that are empty or pure contribute 0
+void entropyTermsScalar(const uint32_t* sums, const uint32_t* maxes, size_t n, double total, double* out) {
+    for (size_t i{}; i != n; ++i) {
+        double siz = sums[i], max = maxes[i];
+        if (!(max < siz)) {
+            out[i] = 0;
+            continue;
+        }
 
-    // Early return to prevent problems due to "log2(0) = -Inf" and IEE754 standard
-    if (pos == 1) return 0;
-    return idxs.size() * ((-pos * std::log2(pos)) - ((1 - pos) * std::log2(1 - pos))) / exs.size();
+        auto pos = max / siz, neg = 1 - pos;
+        out[i] = siz * ((-pos * seriesLog2(pos)) - (neg * seriesLog2(neg))) / total;
+    }
 }
 
-// Compute the error number for the examples using the 'entropy' calculation metric
-double entropy(const Vec<size_t>& idxs, const Vec<Example>& exs) {
-    // Determine the percentage of "correctly" classified examples
-    auto pos = maxClass(idxs, exs).second / double{ idxs.size() };
+#ifdef DT_X86
+// Compare-and-subtract counting for small code ranges, every byte lane counts the matches of one code
+    // Lanes overflow after 255 blocks, so they are summed into 64-bit totals (psadbw) that often
+    // The last code isn't compared at all, its count is whatever the others leave
+DT_TARGET("avx2")
+void countCodesAvx2(const uint8_t* codes, size_t n, size_t card, uint32_t* out) {
+    if (card < 2 || card > 8 || n < 32) return countCodesScalar(codes, n, card, out);
 
-    // Early return to prevent problems due to "log2(0) = -Inf" and IEE754 standard
-    if (pos == 1) return 0;
-    return idxs.size() * ((-pos * std::log2(pos)) - ((1 - pos) * std::log2(1 - pos))) / exs.size();
+    const auto zero = _mm256_setzero_si256();
+    uint64_t totals[8]{};
+    size_t i{};
+    while (n - i >= 32) {
+        __m256i acc[7];
+        for (size_t c{}; c + 1 < card; ++c) acc[c] = zero;
+
+        for (size_t b{ std::min<size_t>((n - i) / 32, 255) }; b; --b, i += 32) {
+            auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(codes + i));
+            for (size_t c{}; c + 1 < card; ++c)
+                acc[c] = _mm256_sub_epi8(acc[c], _mm256_cmpeq_epi8(v, _mm256_set1_epi8(static_cast<char>(c))));
+        }
+
+        for (size_t c{}; c + 1 < card; ++c) {
+            alignas(32) uint64_t lanes[4];
+            _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), _mm256_sad_epu8(acc[c], zero));
+            totals[c] += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+        }
+    }
+
+    uint64_t rest = i;
+    for (size_t c{}; c + 1 < card; ++c) {
+        out[c] += static_cast<uint32_t>(totals[c]);
+        rest -= totals[c];
+    }
+    out[card - 1] += static_cast<uint32_t>(rest);
+
+    countCodesScalar(codes + i, n - i, card, out);
 }
 
-// Compute the error number for the examples, switching on the value for the ErrorMetric 'selector'
-double computeError(const Vec<Example>& exs, size_t l, size_t r, ErrorMetric selector) {
-    if (r - l == 1) return 0;
+DT_TARGET("sse4.1")
+void countCodesSse4(const uint8_t* codes, size_t n, size_t card, uint32_t* out) {
+    if (card < 2 || card > 8 || n < 16) return countCodesScalar(codes, n, card, out);
 
-    // Determine the maximum classification for the given range
-    Map<char, size_t> count;
-    for (size_t idx{ l }; idx != r; ++idx)
-        count[exs[idx].classification]++;
+    const auto zero = _mm_setzero_si128();
+    uint64_t totals[8]{};
+    size_t i{};
+    while (n - i >= 16) {
+        __m128i acc[7];
+        for (size_t c{}; c + 1 < card; ++c) acc[c] = zero;
 
-    auto max = std::max_element(std::begin(count), std::end(count),
-        [](std::pair<const char, size_t>& p1, std::pair<const char, size_t>& p2) { return p1.second < p2.second; });
+        for (size_t b{ std::min<size_t>((n - i) / 16, 255) }; b; --b, i += 16) {
+            auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(codes + i));
+            for (size_t c{}; c + 1 < card; ++c)
+                acc[c] = _mm_sub_epi8(acc[c], _mm_cmpeq_epi8(v, _mm_set1_epi8(static_cast<char>(c))));
+        }
 
-    // If the error is being computed using the "probability of error" metric
-    if (selector == ErrorMetric::PROB_ERROR) return (r - l - max->second) / double{ r - l };
+        for (size_t c{}; c + 1 < card; ++c) {
+            alignas(16) uint64_t lanes[2];
+            _mm_store_si128(reinterpret_cast<__m128i*>(lanes), _mm_sad_epu8(acc[c], zero));
+            totals[c] += lanes[0] + lanes[1];
+        }
+    }
 
-    // Otherwise compute using the entropy metric
-    auto pos = max->second / double{ r - l };
-    if (pos == 1) return 0;
-    return (-pos * std::log2(pos)) - ((1 - pos) * std::log2(1 - pos));
-}
+    uint64_t rest = i;
+    for (size_t c{}; c + 1 < card; ++c) {
+        out[c] += static_cast<uint32_t>(totals[c]);
+        rest -= totals[c];
+    }
+    out[card - 1] += static_cast<uint32_t>(rest);
 
-// Overload for usage in bestDecision
-template<class Entry_T>
-double computeError(const Vec<Example>& exs, Entry_T& entry, size_t siz, ErrorMetric selector) {
-    // Accumulate the error over every value for the current decision
-    return std::accumulate(std::begin(entry.second), std::end(entry.second),
-        0., [&exs, siz, idx=entry.first, selector](double acc, std::pair<const char, Vec<size_t>>& p) {
-            // Perform different accumulations based on the chosen error metric
-            if (selector == ErrorMetric::PROB_ERROR)
-                return acc + countMinorities(p.second, exs);
-            else
-                return acc + entropy(p.second, exs);
-        }) / (selector == ErrorMetric::PROB_ERROR ? siz : 1);
-        // Divide to account for "probability of error" shortcut
+    countCodesScalar(codes + i, n - i, card, out);
 }
 
-// Pick the best decision from the examples
-size_t bestDecision(const Vec<Example>& exs, Vec<size_t> taken, size_t l, size_t r, ErrorMetric selector, std::string b$    auto num_decs = exs.back().attributes.size();
-    auto num_decs = exs.back().attributes.size();
+// seriesLog2 on 4 lanes
+DT_TARGET("avx2")
+__m256d seriesLog2Avx2(__m256d x) {
+    auto bits = _mm256_castpd_si256(x);
+    auto e = _mm256_castsi256_pd(_mm256_or_si256(_mm256_srli_epi64(bits, 52), _mm256_set1_epi64x(0x4330000000000000ll)));
+    auto m = _mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi64x(0x000FFFFFFFFFFFFFll)),
+                                                 _mm256_set1_epi64x(0x3FF0000000000000ll)));
+    e = _mm256_sub_pd(e, _mm256_set1_pd(4503599627371519.0));
 
-    auto t_begin = std::begin(taken);
-    auto t_end = std::end(taken);
+    auto big = _mm256_cmp_pd(m, _mm256_set1_pd(sqrt_2), _CMP_GT_OQ);
+    m = _mm256_blendv_pd(m, _mm256_mul_pd(m, _mm256_set1_pd(0.5)), big);
+    e = _mm256_add_pd(e, _mm256_and_pd(big, _mm256_set1_pd(1)));
 
-    // // Collect the attributes for all decisions for all examples
-    Map<size_t, Map<char, Vec<size_t>>> sort_set;
-    for (size_t ex{ l }; ex != r; ++ex) {
-        for (size_t i{}; i != num_decs; ++i) {
-            if (std::find(t_begin, t_end, i) != t_end) continue;
+    auto one = _mm256_set1_pd(1);
+    auto s = _mm256_div_pd(_mm256_sub_pd(m, one), _mm256_add_pd(m, one));
+    auto z = _mm256_mul_pd(s, s);
+    auto poly = _mm256_set1_pd(log_series[10]);
+    for (int k{9}; k >= 0; --k) poly = _mm256_add_pd(_mm256_mul_pd(poly, z), _mm256_set1_pd(log_series[k]));
 
-            sort_set[i][exs[ex].attributes[i]].push_back(ex);
-        }
-    }
+    return _mm256_add_pd(e, _mm256_mul_pd(_mm256_mul_pd(s, poly), _mm256_set1_pd(log2_e)));
+}
 
-    // Find the decision that performs the best (the one with "minimal error")
-    size_t bestDec = -1;
-    double min_err = std::numeric_limits<double>::max();
-    for (auto& entry : sort_set) {
-        auto err = computeError(exs, entry, r-l, selector);
+DT_TARGET("avx2")
+void entropyTermsAvx2(const uint32_t* sums, const uint32_t* maxes, size_t n, double total, double* out) {
+    const auto one = _mm256_set1_pd(1), zero = _mm256_setzero_pd(), div = _mm256_set1_pd(total);
 
-        std::cout << buf << " error: " << std::fixed << std::setw(6) << std::setprecision(4)
-                  << err << " for " << entry.first << '(' << attr_names[entry.first] << ")\n";
+    size_t i{};
+    for (; i + 4 <= n; i += 4) {
+        auto siz = _mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + i)));
+        auto max = _mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<const __m128i*>(maxes + i)));
+        auto valid = _mm256_cmp_pd(max, siz, _CMP_LT_OQ);
 
-        if (err < min_err) {
-            min_err = err;
-            bestDec = entry.first;
-        }
+        // Empty and pure lanes are computed on a harmless 1/2 and masked out afterwards
+        auto pos = _mm256_blendv_pd(_mm256_set1_pd(0.5), _mm256_div_pd(max, siz), valid);
+        auto neg = _mm256_sub_pd(one, pos);
+        auto h = _mm256_sub_pd(_mm256_mul_pd(_mm256_sub_pd(zero, pos), seriesLog2Avx2(pos)),
+                               _mm256_mul_pd(neg, seriesLog2Avx2(neg)));
+        _mm256_storeu_pd(out + i, _mm256_and_pd(valid, _mm256_div_pd(_mm256_mul_pd(siz, h), div)));
     }
 
-    std::cout << buf << "Decision for indices [" << l << ',' << r << "): "
-              << attr_names[bestDec] << '(' << bestDec << "), error=" << min_err << '\n';
-
-    return bestDec;
+    entropyTermsScalar(sums + i, maxes + i, n - i, total, out + i);
 }
 
-// Partition the example vector on the chosen decision
-Vec<size_t> partition(Vec<Example>& exs, size_t dec, size_t l, size_t r) {
-    // Collect the values for the current decision (determines number of needed partitions)
-    Map<char, size_t> attr_vals;
-    for (size_t ex{ l }; ex != r; ++ex)
-        attr_vals[exs[ex].attributes[dec]] = true;
+// seriesLog2 on 2 lanes
+DT_TARGET("sse4.1")
+__m128d seriesLog2Sse4(__m128d x) {
+    auto bits = _mm_castpd_si128(x);
+    auto e = _mm_castsi128_pd(_mm_or_si128(_mm_srli_epi64(bits, 52), _mm_set1_epi64x(0x4330000000000000ll)));
+    auto m = _mm_castsi128_pd(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi64x(0x000FFFFFFFFFFFFFll)),
+                                           _mm_set1_epi64x(0x3FF0000000000000ll)));
+    e = _mm_sub_pd(e, _mm_set1_pd(4503599627371519.0));
+
+    auto big = _mm_cmpgt_pd(m, _mm_set1_pd(sqrt_2));
+    m = _mm_blendv_pd(m, _mm_mul_pd(m, _mm_set1_pd(0.5)), big);
+    e = _mm_add_pd(e, _mm_and_pd(big, _mm_set1_pd(1)));
+
+    auto one = _mm_set1_pd(1);
+    auto s = _mm_div_pd(_mm_sub_pd(m, one), _mm_add_pd(m, one));
+    auto z = _mm_mul_pd(s, s);
+    auto poly = _mm_set1_pd(log_series[10]);
+    for (int k{9}; k >= 0; --k) poly = _mm_add_pd(_mm_mul_pd(poly, z), _mm_set1_pd(log_series[k]));
+
+    return _mm_add_pd(e, _mm_mul_pd(_mm_mul_pd(s, poly), _mm_set1_pd(log2_e)));
+}
 
-    const auto begin = std::begin(exs);
-    const auto end = begin + r;
-    auto iter = begin + l;
+DT_TARGET("sse4.1")
+void entropyTermsSse4(const uint32_t* sums, const uint32_t* maxes, size_t n, double total, double* out) {
+    const auto one = _mm_set1_pd(1), zero = _mm_setzero_pd(), div = _mm_set1_pd(total);
 
-    Vec<size_t> ret;
-    for (const auto& pair : attr_vals) {
-        // Move all examples with this value to the front of the current vector range
-        // Marks the rest of the vector as the range for the next iteration
-        iter = std::partition(iter, end,
-            [dec, val=pair.first](const Example& e) { return e.attributes[dec] == val; });
+    size_t i{};
+    for (; i + 2 <= n; i += 2) {
+        auto siz = _mm_cvtepi32_pd(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(sums + i)));
+        auto max = _mm_cvtepi32_pd(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(maxes + i)));
+        auto valid = _mm_cmplt_pd(max, siz);
 
-        // Store the index after the end of the partition
-        ret.emplace_back(iter - begin);
+        auto pos = _mm_blendv_pd(_mm_set1_pd(0.5), _mm_div_pd(max, siz), valid);
+        auto neg = _mm_sub_pd(one, pos);
+        auto h = _mm_sub_pd(_mm_mul_pd(_mm_sub_pd(zero, pos), seriesLog2Sse4(pos)),
+                            _mm_mul_pd(neg, seriesLog2Sse4(neg)));
+        _mm_storeu_pd(out + i, _mm_and_pd(valid, _mm_div_pd(_mm_mul_pd(siz, h), div)));
     }
 
-    return ret;
+    entropyTermsScalar(sums + i, maxes + i, n - i, total, out + i);
 }
 
-// Tree class to organize the decision tree
-class DecTree {
-    Vec<DecTree> nodes;
-    const size_t l, r;
-    size_t decision = -1;
+#ifdef _MSC_VER
+bool hasSse4() {
+    int info[4];
+    __cpuid(info, 1);
+    return info[2] & (1 << 19);
+}
 
-    public:
-        // Helper constructor for initial construction
-        DecTree(Vec<Example>& arr, ErrorMetric selector)
-            : DecTree{ arr, {}, 0, arr.size(), computeError(arr, 0, arr.size(), selector), selector, "" } {}
+bool hasAvx2() {
+    int info[4];
+    __cpuid(info, 1);
+    bool os_avx = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6;
+    __cpuidex(info, 7, 0);
+    return os_avx && (info[1] & (1 << 5));
+}
+#else
+bool hasSse4() { return __builtin_cpu_supports("sse4.1"); }
+bool hasAvx2() { return __builtin_cpu_supports("avx2"); }
+#endif
+#endif
 
-        // Constructor for the tree structure
-        DecTree(Vec<Example>& arr, Vec<size_t> taken, size_t l, size_t r, double err, ErrorMetric selector, std::string$                : l{ l }, r{ r } {
+// Set of kernels for one instruction set
+struct Kernels {
+    const char* name;
+    void (*countCodes)(const uint8_t* codes, size_t n, size_t card, uint32_t* out);
+    void (*entropyTerms)(const uint32_t* sums, const uint32_t* maxes, size_t n, double total, double* out);
+    bool (*supported)();
+};
 
-            // Stop if no more decisions can/need to be made
-            if (err == 0 || taken.size() == arr.back().attributes.size()) return;
-            std::cout << buf << "Calculating decision for indices ["
-                      << l << ',' << r << "), current error = " << err << '\n';
-            buf += ' ';
+// Every kernel set, best first (the scalar one works everywhere)
+static const Kernels kernel_sets[] = {
+#ifdef DT_X86
+    { "avx2", countCodesAvx2, entropyTermsAvx2, hasAvx2 },
+    { "sse4.1", countCodesSse4, entropyTermsSse4, hasSse4 },
+#endif
+    { "scalar", countCodesScalar, entropyTermsScalar, [] { return true; } }
+};
 
-            // Find the best decision to take
-            decision = bestDecision(arr, taken, l, r, selector, buf);
-            taken.emplace_back(decision);
+// Get the best kernels the CPU supports, chosen on first use
+const Kernels& kernels() {
+    static const Kernels& best = *std::find_if(std::begin(kernel_sets), std::end(kernel_sets),
+                                               [](const Kernels& k) { return k.supported(); });
+    return best;
+}
 
-            // Take it and construct sub-nodes from the possible values
-            buf += ' ';
-            auto ends = partition(arr, decision, l, r);
-            for (auto r : ends) {
-                nodes.emplace_back(arr, taken, l, r, computeError(arr, l, r, selector), selector, buf);
-                l = r;
+// Flat (attribute x value x class) count histogram used to evaluate every split of a node
+    // The buffer is sized once for the store and reused for every node in the tree
+class SplitHistogram {
+    Vec<uint32_t> counts;
+    Vec<size_t> offsets;
+    size_t num_classes;
+
+    // Per (attribute x value) cell: number of examples, size of the majority class and the cell's error term
+    Vec<uint32_t> sums, maxes;
+    Vec<double> terms;
+
+    public:
+        SplitHistogram(const ExampleStore& exs) : num_classes{ exs.classifications().cardinality() } {
+            size_t siz = 0;
+            for (size_t i{}; i != exs.attributes(); ++i) {
+                offsets.push_back(siz);
+                siz += exs.column(i).cardinality() * num_classes;
             }
+            offsets.push_back(siz);
+
+            counts.resize(siz);
+            sums.resize(siz / std::max<size_t>(num_classes, 1));
+            maxes.resize(sums.size());
+            terms.resize(sums.size());
         }
 
-        // Prints the created decision tree
-        template <class Ostream>
-        Ostream& print(Ostream& s, const Vec<Example>& arr, std::string buf="") {
-            if (!l && r == arr.size()) s << "\nInitial:";
-            if (decision == -1) return s << "Decided " << arr[l].classification << '\n';
+        size_t classes() const { return num_classes; }
 
-            s << attr_names[decision] << '\n';
-            buf += ' ';
-            for (auto& dec : nodes) {
-                s << buf << arr[dec.l].attributes[decision] << ':';
-                dec.print(s, arr, buf);
+        // Get the class counts for the given attribute value
+        const uint32_t* at(size_t attr, uint8_t code) const { return counts.data() + offsets[attr] + code * num_classes; }
+
+        // Count the examples in [l, r) for every untaken attribute in [first, last) in a single pass over the rows
+            // `labels[ex]` holds the class code of the example at `rows[ex]`
+        void fill(const ExampleStore& exs, const Vec<uint32_t>& rows, const uint8_t* labels, const Vec<bool>& taken,
+                  size_t l, size_t r, size_t first, size_t last) {
+            std::fill(std::begin(counts), std::end(counts), 0);
+
+            for (size_t ex{ l }; ex != r; ++ex) {
+                auto row = rows[ex];
+                auto cls = labels[ex];
+
+                for (size_t i{ first }; i != last; ++i)
+                    if (!taken[i]) counts[offsets[i] + exs.column(i)[row] * num_classes + cls]++;
             }
-            return s;
         }
 
-};
+        // Compute the error of splitting on every untaken attribute in [first, last) of a filled histogram
+            // The error terms of all the attributes' values are computed with a single kernel call
+            // Same results as computeError per attribute, apart from the rounding of the logarithm
+        void errors(const Vec<bool>& taken, size_t first, size_t last, size_t siz, size_t total, ErrorMetric selector, double* out,
+                    const Kernels& kern = kernels()) {
+            auto begin = offsets[first] / num_classes, end = offsets[last] / num_classes;
 
+            for (size_t cell{ begin }; cell != end; ++cell) {
+                auto count = counts.data() + cell * num_classes;
+                sums[cell] = std::accumulate(count, count + num_classes, uint32_t{});
+                maxes[cell] = *std::max_element(count, count + num_classes);
+            }
 
-// Read in all examples from the file
-Vec<Example> readFile(int argc, const char* argv[]) {
-    std::ifstream o;
+            if (selector == ErrorMetric::PROB_ERROR) {
+                for (size_t cell{ begin }; cell != end; ++cell) terms[cell] = sums[cell] - maxes[cell];
+            } else {
+                kern.entropyTerms(sums.data() + begin, maxes.data() + begin, end - begin, double(total), terms.data() + begin);
+            }
+
+            // Accumulate in value order, like computeError does
+            for (size_t i{ first }; i != last; ++i) {
+                if (taken[i]) continue;
 
-    // Find the file in the arguments array and open it
-    for (int i{1}; i != argc; ++i)
-        if (argv[i] != std::string{ "-e" }) {
-            o.open(argv[i]);
-            break;
+                double acc = 0;
+                for (size_t cell{ offsets[i] / num_classes }; cell != offsets[i + 1] / num_classes; ++cell)
+                    acc += terms[cell];
+                out[i] = acc / (selector == ErrorMetric::PROB_ERROR ? siz : 1);
+            }
         }
+};
 
-    // Read in the examples from the file
-    Vec<Example> ret;
-    if (o) {
-        std::string line;
-        while (std::getline(o, line))
-            ret.emplace_back(line);
-    }
+// Return the "maximal" classification of the class counts
+std::pair<uint8_t, size_t> maxClass(const uint32_t* count, size_t num_classes) {
+    auto max = std::max_element(count, count + num_classes);
+    return { static_cast<uint8_t>(max - count), *max };
+}
 
-    return ret;
+// Count the number of "wrongly" classified examples assuming a majority decision
+double countMinorities(const uint32_t* count, size_t num_classes, size_t siz) {
+    return siz - maxClass(count, num_classes).second;
 }
 
-// Get the error metric to use (find a '-e' in the arguments array)
-ErrorMetric getErrorMetric(int argc, const char* argv[]) {
-    for (int i{}; i != argc; ++i)
-        if (argv[i] == std::string{"-e"}) return ErrorMetric::ENTROPY;
-    return ErrorMetric::PROB_ERROR;
+// Compute the error number for the examples using the 'entropy' calculation metric
+double entropy(const uint32_t* count, size_t num_classes, size_t siz, size_t total) {
+    // Determine the percentage of "correctly" classified examples
+    auto pos = maxClass(count, num_classes).second / double(siz);
+
+    // Early return to prevent problems due to "log2(0) = -Inf" and IEE754 standard
+    if (pos == 1) return 0;
+    return siz * ((-pos * std::log2(pos)) - ((1 - pos) * std::log2(1 - pos))) / total;
 }
 
-// Run the decision tree program
-int main(int argc, const char* argv[]) {
-    auto examples = readFile(argc, argv);
-    if (examples.size() == 0) return (std::cout << "No data read from the given file\n"), 0;
-    DecTree{ examples, getErrorMetric(argc, argv) }.print(std::cout, examples);
+// Count the classifications of the examples in [l, r), going through `rows` to the store's packed column
+    // Training counts the contiguous class codes of a node with `countCodes` instead, this is the scalar reference
+std::array<uint32_t, 256> countClasses(const ExampleStore& exs, const Vec<uint32_t>& rows, size_t l, size_t r) {
+    auto& classes = exs.classifications();
+
+    std::array<uint32_t, 256> count{};
+    for (size_t idx{ l }; idx != r; ++idx)
+        count[classes[rows[idx]]]++;
+
+    return count;
+}
+
+// Compute the error number for the class counts, switching on the value for the ErrorMetric 'selector'
+double computeError(const uint32_t* count, size_t num_classes, size_t siz, ErrorMetric selector) {
+    if (siz == 1) return 0;
+
+    // Determine the maximum classification for the given range
+    auto max = maxClass(count, num_classes).second;
+
+    // If the error is being computed using the "probability of error" metric
+    if (selector == ErrorMetric::PROB_ERROR) return (siz - max) / double(siz);
+
+    // Otherwise compute using the entropy metric
+    auto pos = max / double(siz);
+    if (pos == 1) return 0;
+    return (-pos * std::log2(pos)) - ((1 - pos) * std::log2(1 - pos));
+}
+
+// Overload for usage in bestDecision
+double computeError(const ExampleStore& exs, const SplitHistogram& hist, size_t attr, size_t siz, ErrorMetric selector) {
+    auto num_classes = hist.classes();
+
+    // Accumulate the error over every value for the current decision
+    double acc = 0;
+    for (size_t code{}; code != exs.column(attr).cardinality(); ++code) {
+        auto count = hist.at(attr, static_cast<uint8_t>(code));
+        auto num = std::accumulate(count, count + num_classes, size_t{});
+        if (!num) continue;
+
+        // Perform different accumulations based on the chosen error metric
+        if (selector == ErrorMetric::PROB_ERROR)
+            acc += countMinorities(count, num_classes, num);
+        else
+            acc += entropy(count, num_classes, num, exs.size());
+    }
+
+    // Divide to account for "probability of error" shortcut
+    return acc / (selector == ErrorMetric::PROB_ERROR ? siz : 1);
+}
+
+// Nodes with at least this many examples evaluate their candidate splits in parallel
+constexpr size_t parallel_split_rows = 1 << 16;
+
+// Nodes with at least this many examples build their subtrees as separate tasks
+constexpr size_t parallel_tree_rows = 1 << 12;
+
+// Small, portable pseudo-random generator (splitmix64)
+    // Seeded from the tree and node, so random choices don't depend on the task schedule
+struct SplitMix {
+    uint64_t state;
+
+    uint64_t operator()() {
+        auto z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // Get a number in [0, n)
+    size_t below(size_t n) { return static_cast<size_t>((*this)() % n); }
+};
+
+// Record of the work done by every node while training, only collected when a trace was requested
+    // Every worker appends to its own buffer, so recording a node never takes a lock
+class TrainTrace {
+    using clock = std::chrono::steady_clock;
+
+    public:
+        // Work done by a single node, not counting its subtrees
+        struct Node {
+            uint32_t tree = 0;
+            uint32_t depth = 0;
+            size_t l = 0, r = 0;        // Range of `rows` covered by the node, every pass over it examines r - l rows
+            size_t decision = 0;        // Attribute the node splits on (-1 for leaves)
+            size_t candidates = 0;      // Number of attributes whose split was evaluated
+            size_t allocations = 0;     // Heap allocations made by the thread building the node (0 unless counted)
+            double error = 0;
+            double start = 0, duration = 0;     // Microseconds since the trace started
+            size_t worker = 0;
+        };
+
+    private:
+        clock::time_point origin = clock::now();
+        Vec<Vec<Node>> nodes;
+
+        // All recorded nodes, ordered by tree and start time
+        Vec<Node> sorted() const {
+            Vec<Node> ret;
+            for (auto& buf : nodes) ret.insert(std::end(ret), std::begin(buf), std::end(buf));
+            std::sort(std::begin(ret), std::end(ret), [](const Node& a, const Node& b) {
+                return a.tree != b.tree ? a.tree < b.tree : a.start < b.start;
+            });
+            return ret;
+        }
+
+        static std::string name(size_t decision) {
+            if (decision == size_t(-1)) return "leaf";
+            return decision < attr_names.size() ? attr_names[decision] : std::to_string(decision);
+        }
+
+    public:
+        explicit TrainTrace(size_t workers) : nodes(workers) {}
+
+        double now() const { return std::chrono::duration<double, std::micro>(clock::now() - origin).count(); }
+        void record(const Node& node) { nodes[node.worker].push_back(node); }
+
+        // Write the nodes as a JSON array of objects
+        std::ostream& writeJson(std::ostream& s) const {
+            auto all = sorted();
+            s << std::fixed << std::setprecision(3) << "{\"nodes\":[";
+            for (size_t i{}; i != all.size(); ++i) {
+                auto& n = all[i];
+                s << (i ? ",\n" : "\n") << "{\"tree\":" << n.tree << ",\"depth\":" << n.depth
+                  << ",\"begin\":" << n.l << ",\"end\":" << n.r << ",\"rows\":" << n.r - n.l
+                  << ",\"decision\":\"" << name(n.decision) << "\",\"candidates\":" << n.candidates
+                  << ",\"allocations\":" << n.allocations << ",\"error\":" << std::setprecision(6) << n.error << std::setprecision(3)
+                  << ",\"start_us\":" << n.start << ",\"duration_us\":" << n.duration << ",\"worker\":" << n.worker << '}';
+            }
+            return s << "\n]}\n";
+        }
+
+        // Write the nodes as Chrome trace events (load in chrome://tracing or Perfetto), one track per tree and worker
+        std::ostream& writeChrome(std::ostream& s) const {
+            auto all = sorted();
+            s << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+            for (size_t i{}; i != all.size(); ++i) {
+                auto& n = all[i];
+                s << (i ? ",\n" : "\n") << "{\"name\":\"" << name(n.decision) << "\",\"cat\":\"node\",\"ph\":\"X\""
+                  << ",\"ts\":" << n.start << ",\"dur\":" << n.duration << ",\"pid\":" << n.tree << ",\"tid\":" << n.worker
+                  << ",\"args\":{\"depth\":" << n.depth << ",\"begin\":" << n.l << ",\"end\":" << n.r
+                  << ",\"rows\":" << n.r - n.l << ",\"candidates\":" << n.candidates
+                  << ",\"allocations\":" << n.allocations << ",\"error\":" << std::setprecision(6) << n.error << std::setprecision(3) << "}}";
+            }
+            return s << "\n],\"displayTimeUnit\":\"ms\"}\n";
+        }
+
+        bool save(const std::string& file, TraceFormat format) const {
+            std::ofstream o{ file };
+            if (format == TraceFormat::JSON) writeJson(o);
+            else writeChrome(o);
+            return o.good();
+        }
+};
+
+// Everything shared by the nodes of a tree while it is being built
+struct TrainContext {
+    const ExampleStore& exs;
+    Vec<uint32_t>& rows;
+    Vec<uint32_t> scratch;      // Partitioning buffer, every node only touches its own [l, r) slice
+    Vec<uint8_t> labels;        // Class code of the example at every position of `rows`, permuted along with it
+    Vec<uint8_t> spare_labels;
+    ErrorMetric selector;
+    TaskPool& pool;
+    Scratch<SplitHistogram> hists;
+
+    size_t features;            // Number of random attributes considered at every node (0 considers them all)
+    uint64_t seed;
+
+    TrainTrace* trace;          // Only set when the nodes' work should be recorded
+    uint32_t tree;
+
+    TrainContext(const ExampleStore& exs, Vec<uint32_t>& rows, ErrorMetric selector, TaskPool& pool,
+                 size_t features, uint64_t seed, TrainTrace* trace, uint32_t tree)
+        : exs{ exs }, rows{ rows }, scratch(rows.size()), labels(rows.size()), spare_labels(rows.size()),
+          selector{ selector }, pool{ pool },
+          hists{ pool, [&exs] { return std::make_unique<SplitHistogram>(exs); } },
+          features{ features }, seed{ seed }, trace{ trace }, tree{ tree } {
+        for (size_t i{}; i != rows.size(); ++i) labels[i] = exs.classifications()[rows[i]];
+    }
+};
+
+// Pick the best decision from the examples, attributes marked in `taken` are not considered
+    // `ctx.rows` holds the indices of the examples in the store, with [l, r) being the current node
+size_t bestDecision(TrainContext& ctx, const Vec<bool>& taken, size_t l, size_t r) {
+    auto& exs = ctx.exs;
+    auto num_decs = exs.attributes();
+    Vec<double> errs(num_decs, std::numeric_limits<double>::max());
+
+    // Count the classes for all values of all decisions
+        // Large nodes split the attributes between tasks that each make their own pass over the rows
+    auto chunks = r - l >= parallel_split_rows ? std::min(ctx.pool.size(), num_decs) : 1;
+    auto evaluate = [&](size_t first, size_t last) {
+        auto hist = ctx.hists.acquire();
+        hist->fill(exs, ctx.rows, ctx.labels.data(), taken, l, r, first, last);
+        hist->errors(taken, first, last, r - l, exs.size(), ctx.selector, errs.data());
+    };
+
+    if (chunks == 1) {
+        evaluate(0, num_decs);
+    } else {
+        TaskGroup group{ ctx.pool };
+        for (size_t c{}; c != chunks; ++c)
+            group.run([&evaluate, c, chunks, num_decs] { evaluate(c * num_decs / chunks, (c + 1) * num_decs / chunks); });
+        group.wait();
+    }
+
+    // Find the decision that performs the best (the one with "minimal error")
+        // Ties always go to the lowest attribute, so the tree doesn't depend on the task schedule
+    size_t bestDec = -1;
+    double min_err = std::numeric_limits<double>::max();
+    for (size_t i{}; i != num_decs; ++i) {
+        if (!taken[i] && errs[i] < min_err) {
+            min_err = errs[i];
+            bestDec = i;
+        }
+    }
+
+    return bestDec;
+}
+
+// Partitions of a node's examples after splitting on a decision
+struct Split {
+    size_t count = 0;
+    std::array<uint8_t, 256> values;        // Value code of every partition
+    std::array<size_t, 256> ends;           // Index after the end of every partition
+};
+
+// Partition the examples in [l, r) on the chosen decision with a single counting sort
+    // Only the 4-byte indices in `rows` move (through the same slice of `scratch`), nothing is allocated
+    // Partitions come out in value code order and keep the relative order of their examples
+    // With `labels` given, the per-position class codes are moved along with the indices (through `spare`)
+Split partition(const ExampleStore& exs, Vec<uint32_t>& rows, Vec<uint32_t>& scratch, size_t dec, size_t l, size_t r,
+                uint8_t* labels = nullptr, uint8_t* spare = nullptr) {
+    auto& col = exs.column(dec);
+    auto card = col.cardinality();
+
+    // Count the examples with every value
+    std::array<size_t, 256> pos{};
+    for (size_t ex{ l }; ex != r; ++ex)
+        pos[col[rows[ex]]]++;
+
+    // Turn the counts into the start of every partition
+    Split ret;
+    for (size_t code{}, start{ l }; code != card; ++code) {
+        if (!pos[code]) continue;
+
+        auto num = pos[code];
+        pos[code] = start;
+        start += num;
+
+        ret.values[ret.count] = static_cast<uint8_t>(code);
+        ret.ends[ret.count++] = start;
+    }
+
+    // Scatter the indices into their partitions and copy them back
+    if (labels) {
+        for (size_t ex{ l }; ex != r; ++ex) {
+            auto at = pos[col[rows[ex]]]++;
+            scratch[at] = rows[ex];
+            spare[at] = labels[ex];
+        }
+        std::copy(spare + l, spare + r, labels + l);
+    } else {
+        for (size_t ex{ l }; ex != r; ++ex)
+            scratch[pos[col[rows[ex]]]++] = rows[ex];
+    }
+
+    std::copy(std::begin(scratch) + l, std::begin(scratch) + r, std::begin(rows) + l);
+    return ret;
+}
+
+class Model;
+
+// Tree class to organize the decision tree
+class DecTree {
+    Vec<DecTree> nodes;
+    const size_t l, r;
+    size_t decision = -1;
+    uint8_t value = 0;                  // Code of the parent's decision value that leads to this node
+    uint8_t classification = 0;         // Code of the majority classification of the node's examples
+    Vec<uint32_t> counts;               // Number of the node's examples in every classification
+
+    friend class Model;
+
+    // Mark all but `ctx.features` randomly chosen untaken attributes as unavailable to the node
+    Vec<bool> sampleAttributes(const TrainContext& ctx, const Vec<bool>& taken) const {
+        Vec<size_t> open;
+        for (size_t i{}; i != taken.size(); ++i)
+            if (!taken[i]) open.push_back(i);
+
+        if (!ctx.features || ctx.features >= open.size()) return taken;
+
+        auto depth = taken.size() - open.size();
+        SplitMix rng{ ctx.seed ^ (l * 0xD6E8FEB86659FD93ull) ^ (r * 0xA0761D6478BD642Full) ^ depth };
+
+        Vec<bool> skip(taken.size(), true);
+        for (size_t i{}; i != ctx.features; ++i) {
+            std::swap(open[i], open[i + rng.below(open.size() - i)]);
+            skip[open[i]] = false;
+        }
+
+        return skip;
+    }
+
+    // Expand the node, building the subtrees for the chosen decision
+        // Children cover disjoint ranges of `ctx.rows`, so large ones are built as separate tasks
+    void build(TrainContext& ctx, Vec<bool> taken) {
+        // The clock and allocation counter are only read when tracing
+            // Tasks this thread helps with while waiting in bestDecision belong to other nodes, their work is taken out
+        TrainTrace::Node trace{ ctx.tree, 0, l, r, size_t(-1) };
+        HelpedWork helped;
+        bool measured_help = TaskPool::measure_help;
+        if (ctx.trace) {
+            trace.start = ctx.trace->now();
+            trace.allocations = allocationCount();
+            helped = TaskPool::help;
+            TaskPool::measure_help = true;
+        }
+
+        auto num_classes = ctx.exs.classifications().cardinality();
+        std::array<uint32_t, 256> count{};
+        kernels().countCodes(ctx.labels.data() + l, r - l, num_classes, count.data());
+        auto err = computeError(count.data(), num_classes, r - l, ctx.selector);
+        classification = maxClass(count.data(), num_classes).first;
+        counts.assign(std::begin(count), std::begin(count) + num_classes);
+
+        // Record the node's own work, before any of its subtrees are built
+        auto record = [&] {
+            if (!ctx.trace) return;
+
+            trace.depth = static_cast<uint32_t>(std::count(std::begin(taken), std::end(taken), true) - (decision != size_t(-1)));
+            trace.decision = decision;
+            trace.error = err;
+            trace.allocations = allocationCount() - trace.allocations - (TaskPool::help.allocations - helped.allocations);
+            trace.duration = ctx.trace->now() - trace.start - (TaskPool::help.micros - helped.micros);
+            trace.worker = ctx.pool.worker();
+            ctx.trace->record(trace);
+            TaskPool::measure_help = measured_help;
+        };
+
+        // Stop if no more decisions can/need to be made
+        if (err == 0 || std::find(std::begin(taken), std::end(taken), false) == std::end(taken)) return record();
+
+        // Find the best decision to take
+        auto open = sampleAttributes(ctx, taken);
+        if (ctx.trace) trace.candidates = std::count(std::begin(open), std::end(open), false);
+
+        decision = bestDecision(ctx, open, l, r);
+        taken[decision] = true;
+
+        // Take it and construct sub-nodes from the possible values
+        auto split = partition(ctx.exs, ctx.rows, ctx.scratch, decision, l, r, ctx.labels.data(), ctx.spare_labels.data());
+
+        nodes.reserve(split.count);
+        for (size_t i{}, start{ l }; i != split.count; start = split.ends[i++])
+            nodes.emplace_back(start, split.ends[i], split.values[i]);
+        record();
+
+        TaskGroup group{ ctx.pool };
+        for (auto& node : nodes) {
+            auto expand = [&ctx, &node, &taken] { node.build(ctx, taken); };
+
+            if (node.r - node.l >= parallel_tree_rows)
+                group.run(expand);
+            else
+                expand();
+        }
+        group.wait();
+    }
+
+    public:
+        // Unexpanded node covering the examples in [l, r), reached by the given decision value
+        DecTree(size_t l, size_t r, uint8_t value) : l{ l }, r{ r }, value{ value } {}
+
+        // Build the tree for all examples, `rows` is reordered so every node covers a contiguous range
+            // With `features` set, every node only considers that many randomly chosen attributes
+            // With `trace` set, every node records its work as part of the given tree
+        DecTree(const ExampleStore& exs, Vec<uint32_t>& rows, ErrorMetric selector, TaskPool& pool,
+                size_t features = 0, uint64_t seed = 0, TrainTrace* trace = nullptr, uint32_t tree = 0)
+                : DecTree{ 0, rows.size(), 0 } {
+            TrainContext ctx{ exs, rows, selector, pool, features, seed, trace, tree };
+            build(ctx, Vec<bool>(exs.attributes()));
+        }
+
+        // Prints the created decision tree
+        template <class Ostream>
+        Ostream& print(Ostream& s, const ExampleStore& exs, std::string buf="") const {
+            if (buf.empty()) s << "\nInitial:";
+            if (decision == size_t(-1)) return s << "Decided " << exs.classifications().value(classification) << '\n';
+
+            s << attr_names[decision] << '\n';
+            buf += ' ';
+            for (auto& dec : nodes) {
+                s << buf << exs.column(decision).value(dec.value) << ':';
+                dec.print(s, exs, buf);
+            }
+            return s;
+        }
+
+};
+
+// Compiled, immutable form of a trained tree that doesn't depend on the training data
+    // The whole model is one contiguous image, in exactly the layout that `save` writes to disk,
+    // so `load` only has to map the file and point at its sections.
+    //
+    // Nodes live in one array in breadth-first order. Every internal node owns a slice of `children`,
+    // indexed by value code, with one extra slot for values the node never saw during training.
+    // Those slots lead to a leaf holding the node's majority classification.
+class Model {
+    static constexpr uint32_t leaf = -1;
+    static constexpr uint32_t version = 2;
+    static constexpr uint32_t endian = 0x01020304;
+    static constexpr char magic[8] = { 'D', 'E', 'C', 'T', 'R', 'E', 'E', '\0' };
+
+    struct Node {
+        uint32_t attr;          // Attribute to split on (`leaf` for leaves)
+        uint32_t arg;           // Start of the node's child slice, or the classification code for leaves
+    };
+
+    // Code -> value dictionary for a single attribute
+    struct Dict {
+        uint16_t size;
+        char values[256];
+    };
+
+    // Fixed-size header at the start of the image, every section is found through its byte offset
+        // Sections are aligned to 8 bytes, all values are in the writer's byte order (checked through `endian`)
+    struct Header {
+        char magic[8];
+        uint32_t version, endian;
+        uint32_t num_attrs, num_classes, num_nodes, num_children;
+        uint64_t names, nodes, children, codes, dicts, classes, dists, size;
+    };
+
+    Vec<uint64_t> owned;
+    MappedFile mapped;
+
+    const char* base = nullptr;
+    const Header* header = nullptr;
+    const uint32_t* names = nullptr;                    // num_attrs + 1 offsets into the name chars that follow
+    const Node* nodes = nullptr;
+    const uint32_t* children = nullptr;
+    const std::array<uint16_t, 256>* codes = nullptr;   // Per attribute: value -> code (unseen values map to the extra slot)
+    const Dict* dicts = nullptr;
+    const char* classes = nullptr;                      // Classification code -> value
+    const float* dists = nullptr;                       // Per node: fraction of its training examples in every classification
+
+    // Point the section pointers into the image
+    void bind(const char* image) {
+        base = image;
+        header = reinterpret_cast<const Header*>(image);
+        names = reinterpret_cast<const uint32_t*>(image + header->names);
+        nodes = reinterpret_cast<const Node*>(image + header->nodes);
+        children = reinterpret_cast<const uint32_t*>(image + header->children);
+        codes = reinterpret_cast<const std::array<uint16_t, 256>*>(image + header->codes);
+        dicts = reinterpret_cast<const Dict*>(image + header->dicts);
+        classes = image + header->classes;
+        dists = reinterpret_cast<const float*>(image + header->dists);
+    }
+
+    public:
+        Model() = default;
+        Model(Model&&) = default;
+        Model& operator=(Model&&) = default;
+
+        Model(const DecTree& tree, const ExampleStore& exs, const Vec<std::string>& labels) {
+            auto num_attrs = exs.attributes();
+            auto num_classes = exs.classifications().cardinality();
+            Vec<Node> tree_nodes;
+            Vec<uint32_t> tree_children;
+            Vec<float> tree_dists;
+
+            // Record the classification fractions of the given node's examples for node `idx`
+            auto distribution = [&](uint32_t idx, const DecTree* dec) {
+                tree_dists.resize(std::max(tree_dists.size(), (idx + 1) * num_classes));
+
+                auto total = std::accumulate(std::begin(dec->counts), std::end(dec->counts), 0.);
+                for (size_t c{}; c != num_classes; ++c)
+                    tree_dists[idx * num_classes + c] = static_cast<float>(dec->counts[c] / total);
+            };
+
+            // Lay the nodes out breadth-first, so every level is contiguous
+            Vec<std::pair<const DecTree*, uint32_t>> queue{ { &tree, 0 } };
+            tree_nodes.push_back({});
+
+            for (size_t i{}; i != queue.size(); ++i) {
+                auto [dec, idx] = queue[i];
+                distribution(idx, dec);
+
+                if (dec->decision == size_t(-1)) {
+                    tree_nodes[idx] = { leaf, dec->classification };
+                    continue;
+                }
+
+                auto slots = exs.column(dec->decision).cardinality() + 1;
+                auto start = tree_children.size();
+                tree_nodes[idx] = { static_cast<uint32_t>(dec->decision), static_cast<uint32_t>(start) };
+
+                // Unseen values fall back to a leaf with the node's majority classification
+                tree_children.resize(start + slots, static_cast<uint32_t>(tree_nodes.size()));
+                distribution(static_cast<uint32_t>(tree_nodes.size()), dec);
+                tree_nodes.push_back({ leaf, dec->classification });
+
+                for (auto& child : dec->nodes) {
+                    tree_children[start + child.value] = static_cast<uint32_t>(tree_nodes.size());
+                    queue.emplace_back(&child, static_cast<uint32_t>(tree_nodes.size()));
+                    tree_nodes.push_back({});
+                }
+            }
+
+            // Size every section
+            Header h{};
+            std::copy(std::begin(magic), std::end(magic), h.magic);
+            h.version = version;
+            h.endian = endian;
+            h.num_attrs = static_cast<uint32_t>(num_attrs);
+            h.num_classes = static_cast<uint32_t>(exs.classifications().cardinality());
+            h.num_nodes = static_cast<uint32_t>(tree_nodes.size());
+            h.num_children = static_cast<uint32_t>(tree_children.size());
+
+            size_t name_chars{};
+            for (size_t a{}; a != num_attrs; ++a)
+                name_chars += a < labels.size() ? labels[a].size() : 0;
+
+            size_t pos = sizeof(Header);
+            auto place = [&pos](size_t bytes) {
+                auto at = pos;
+                pos = (pos + bytes + 7) & ~size_t{ 7 };
+                return at;
+            };
+
+            h.names = place((num_attrs + 1) * sizeof(uint32_t) + name_chars);
+            h.nodes = place(tree_nodes.size() * sizeof(Node));
+            h.children = place(tree_children.size() * sizeof(uint32_t));
+            h.codes = place(num_attrs * sizeof(std::array<uint16_t, 256>));
+            h.dicts = place(num_attrs * sizeof(Dict));
+            h.classes = place(h.num_classes);
+            h.dists = place(tree_dists.size() * sizeof(float));
+            h.size = pos;
+
+            // Fill in the image
+            owned.assign(pos / sizeof(uint64_t), 0);
+            auto image = reinterpret_cast<char*>(owned.data());
+            std::memcpy(image, &h, sizeof(Header));
+            std::memcpy(image + h.nodes, tree_nodes.data(), tree_nodes.size() * sizeof(Node));
+            std::memcpy(image + h.children, tree_children.data(), tree_children.size() * sizeof(uint32_t));
+
+            auto name_offs = reinterpret_cast<uint32_t*>(image + h.names);
+            auto name_chars_at = reinterpret_cast<char*>(name_offs + num_attrs + 1);
+            name_offs[0] = 0;
+            for (size_t a{}; a != num_attrs; ++a) {
+                auto name = a < labels.size() ? labels[a] : std::string{};
+                std::copy(std::begin(name), std::end(name), name_chars_at + name_offs[a]);
+                name_offs[a + 1] = static_cast<uint32_t>(name_offs[a] + name.size());
+            }
+
+            auto attr_codes = reinterpret_cast<std::array<uint16_t, 256>*>(image + h.codes);
+            auto attr_dicts = reinterpret_cast<Dict*>(image + h.dicts);
+            for (size_t a{}; a != num_attrs; ++a) {
+                auto& col = exs.column(a);
+                attr_codes[a].fill(static_cast<uint16_t>(col.cardinality()));
+                attr_dicts[a].size = static_cast<uint16_t>(col.cardinality());
+
+                for (size_t c{}; c != col.cardinality(); ++c) {
+                    auto val = col.value(static_cast<uint8_t>(c));
+                    attr_codes[a][static_cast<unsigned char>(val)] = static_cast<uint16_t>(c);
+                    attr_dicts[a].values[c] = val;
+                }
+            }
+
+            for (size_t c{}; c != h.num_classes; ++c)
+                image[h.classes + c] = exs.classifications().value(static_cast<uint8_t>(c));
+
+            std::memcpy(image + h.dists, tree_dists.data(), tree_dists.size() * sizeof(float));
+
+            bind(image);
+        }
+
+        // Map a saved model, the model is used straight out of the mapping
+            // Only the header is checked, problems are reported to `errs` and leave the model empty
+        static Model load(const std::string& file, std::ostream& errs) {
+            Model ret;
+            ret.mapped = MappedFile{ file };
+
+            auto& map = ret.mapped;
+            auto h = reinterpret_cast<const Header*>(map.data());
+
+            if (!map) errs << file << ": could not be read\n";
+            else if (map.size() < sizeof(Header) || !std::equal(std::begin(magic), std::end(magic), h->magic)) errs << file << ": not a decision tree model\n";
+            else if (h->endian != endian) errs << file << ": model was written with a different byte order\n";
+            else if (h->version != version) errs << file << ": unsupported model version " << h->version << '\n';
+            else if (h->size > map.size()) errs << file << ": model is truncated\n";
+            else {
+                ret.bind(map.data());
+                return ret;
+            }
+
+            return {};
+        }
+
+        // Write the model image to the file
+        bool save(const std::string& file) const {
+            std::ofstream o{ file, std::ios::binary };
+            return o.write(base, header->size).good();
+        }
+
+        explicit operator bool() const { return base; }
+        size_t attributes() const { return header->num_attrs; }
+        size_t size() const { return header->num_nodes; }
+
+        std::string_view attributeName(size_t attr) const {
+            return { reinterpret_cast<const char*>(names + header->num_attrs + 1) + names[attr], names[attr + 1] - names[attr] };
+        }
+
+        // Get the dictionary of values that the given attribute was trained on
+        std::string_view values(size_t attr) const { return { dicts[attr].values, dicts[attr].size }; }
+        std::string_view classifications() const { return { classes, header->num_classes }; }
+
+        // Find the leaf that a single row ends up in, the row's value for attribute `a` is `row[a * stride]`
+        uint32_t walk(const char* row, size_t stride = 1) const {
+            uint32_t idx = 0;
+            while (nodes[idx].attr != leaf)
+                idx = children[nodes[idx].arg + codes[nodes[idx].attr][static_cast<unsigned char>(row[nodes[idx].attr * stride])]];
+
+            return idx;
+        }
+
+        // Find the leaves that `n` rows end up in
+            // Rows are walked down the tree in groups, one level per pass, so the lookups of different rows overlap
+        void walk(const char* const* rows, size_t n, uint32_t* out, size_t stride = 1) const {
+            constexpr size_t lanes = 16;
+
+            for (size_t b{}; b < n; b += lanes) {
+                auto m = std::min(lanes, n - b);
+                auto cur = out + b;
+                std::fill(cur, cur + m, 0);
+
+                for (bool moved = true; moved; ) {
+                    moved = false;
+                    for (size_t i{}; i != m; ++i) {
+                        auto& node = nodes[cur[i]];
+                        if (node.attr == leaf) continue;
+
+                        cur[i] = children[node.arg + codes[node.attr][static_cast<unsigned char>(rows[b + i][node.attr * stride])]];
+                        moved = true;
+                    }
+                }
+            }
+        }
+
+        // Get the classification code of the given leaf
+        uint8_t classification(uint32_t leaf_idx) const { return static_cast<uint8_t>(nodes[leaf_idx].arg); }
+
+        // Get the fraction of the leaf's training examples in every classification
+        const float* distribution(uint32_t leaf_idx) const { return dists + leaf_idx * header->num_classes; }
+
+        // Classify a single row
+        char predict(const char* row, size_t stride = 1) const { return classes[classification(walk(row, stride))]; }
+
+        // Classify `n` rows into `out`
+        void predict(const char* const* rows, size_t n, char* out, size_t stride = 1) const {
+            constexpr size_t block = 1024;
+            std::array<uint32_t, block> leaves;
+
+            for (size_t b{}; b < n; b += block) {
+                auto m = std::min(block, n - b);
+                walk(rows + b, m, leaves.data(), stride);
+
+                for (size_t i{}; i != m; ++i)
+                    out[b + i] = classes[classification(leaves[i])];
+            }
+        }
+
+        Vec<char> predict(const Vec<const char*>& rows, size_t stride = 1) const {
+            Vec<char> ret(rows.size());
+            predict(rows.data(), rows.size(), ret.data(), stride);
+            return ret;
+        }
+};
+
+
+// Settings for training a forest
+struct ForestOptions {
+    size_t trees = 0;               // Number of trees (0 trains a single tree on all examples)
+    size_t features = 0;            // Attributes considered at every node (0 picks the square root of the attribute count)
+    Vote vote = Vote::MAJORITY;
+    uint64_t seed = 0;
+};
+
+// Bagged ensemble of trees
+    // Every tree is trained on a bootstrap sample of the examples, choosing from a random subset of the attributes at every node
+    // The samples are index views into the shared store, so the examples themselves are never copied
+class Forest {
+    Vec<Model> trees;
+    Vote vote;
+    std::string classes;
+
+    public:
+        Forest(const ExampleStore& exs, const ForestOptions& opts, ErrorMetric selector, TaskPool& pool, TrainTrace* trace = nullptr)
+                : trees(opts.trees), vote{ opts.vote } {
+            auto features = opts.features ? opts.features : std::max<size_t>(1, std::lround(std::sqrt(exs.attributes())));
+
+            TaskGroup group{ pool };
+            for (size_t t{}; t != trees.size(); ++t) {
+                group.run([&, t] {
+                    SplitMix rng{ opts.seed ^ ((t + 1) * 0x9E3779B97F4A7C15ull) };
+
+                    // Draw the bootstrap sample
+                    Vec<uint32_t> rows(exs.size());
+                    for (auto& row : rows) row = static_cast<uint32_t>(rng.below(exs.size()));
+
+                    DecTree tree{ exs, rows, selector, pool, features, rng(), trace, static_cast<uint32_t>(t) };
+                    trees[t] = Model{ tree, exs, attr_names };
+                });
+            }
+            group.wait();
+
+            for (size_t c{}; c != exs.classifications().cardinality(); ++c)
+                classes.push_back(exs.classifications().value(static_cast<uint8_t>(c)));
+        }
+
+        size_t size() const { return trees.size(); }
+        size_t attributes() const { return trees.front().attributes(); }
+
+        // Classify `n` rows into `out`, the value of row `i` for attribute `a` is `rows[i][a * stride]`
+            // Every tree walks a whole block of rows before the next tree, so each tree stays in cache while voting
+        void predict(const char* const* rows, size_t n, char* out, size_t stride = 1) const {
+            constexpr size_t block = 1024;
+            std::array<uint32_t, block> leaves;
+
+            auto num_classes = classes.size();
+            Vec<float> votes(block * num_classes);
+
+            for (size_t b{}; b < n; b += block) {
+                auto m = std::min(block, n - b);
+                std::fill(std::begin(votes), std::end(votes), 0.f);
+
+                for (auto& tree : trees) {
+                    tree.walk(rows + b, m, leaves.data(), stride);
+
+                    for (size_t i{}; i != m; ++i) {
+                        auto row_votes = &votes[i * num_classes];
+                        if (vote == Vote::MAJORITY) {
+                            row_votes[tree.classification(leaves[i])] += 1;
+                        } else {
+                            auto dist = tree.distribution(leaves[i]);
+                            for (size_t c{}; c != num_classes; ++c) row_votes[c] += dist[c];
+                        }
+                    }
+                }
+
+                // Ties go to the lowest classification code
+                for (size_t i{}; i != m; ++i) {
+                    auto row_votes = &votes[i * num_classes];
+                    out[b + i] = classes[std::max_element(row_votes, row_votes + num_classes) - row_votes];
+                }
+            }
+        }
+
+        char predict(const char* row, size_t stride = 1) const {
+            char ret;
+            predict(&row, 1, &ret, stride);
+            return ret;
+        }
+
+        Vec<char> predict(const Vec<const char*>& rows, size_t stride = 1) const {
+            Vec<char> ret(rows.size());
+            predict(rows.data(), rows.size(), ret.data(), stride);
+            return ret;
+        }
+};
+
+
+// Incrementally trained tree in the style of a Hoeffding tree
+    // Leaves keep per-attribute (value x class) counts of the examples that reached them, never the examples.
+    // Every `grace` examples a leaf uses the Hoeffding bound to check whether its best split beats the runner-up
+    // with probability 1 - `delta`, and only then splits. Learning costs O(depth + attributes) per example, so
+    // a batch costs time proportional to its size no matter how much has been seen before.
+class StreamingTree {
+    static constexpr double delta = 1e-7;
+    static constexpr double tie = 0.05;
+    static constexpr uint32_t grace = 200;
+
+    // Growable (value code x class) count table
+    struct Counts {
+        Vec<uint32_t> counts;
+        size_t values = 0, classes = 0;
+
+        void add(size_t val, size_t cls) {
+            if (val >= values || cls >= classes) grow(std::max(values, val + 1), std::max(classes, cls + 1));
+            counts[val * classes + cls]++;
+        }
+
+        void grow(size_t num_values, size_t num_classes) {
+            Vec<uint32_t> bigger(num_values * num_classes);
+            for (size_t v{}; v != values; ++v)
+                std::copy_n(&counts[v * classes], classes, &bigger[v * num_classes]);
+
+            counts.swap(bigger);
+            values = num_values;
+            classes = num_classes;
+        }
+
+        // Get the class counts for the given value
+        const uint32_t* at(size_t val) const { return &counts[val * classes]; }
+    };
+
+    struct Node {
+        size_t decision = -1;
+        Vec<uint32_t> children;         // Per value code (0 if no example with the value has been routed yet)
+        Vec<uint32_t> classes;          // Number of the examples that reached the node in every classification
+        Vec<Counts> stats;              // Per attribute, only kept by leaves
+        Vec<bool> taken;
+        uint32_t seen = 0;              // Examples learned since the node became a leaf
+    };
+
+    Vec<Node> nodes;
+    Vec<std::array<uint16_t, 256>> codes;       // Per attribute: value -> code + 1 (0 marks an unseen value)
+    Vec<std::string> values;                    // Per attribute: code -> value
+    std::array<uint16_t, 256> class_codes{};
+    std::string class_values;
+    ErrorMetric selector;
+    size_t num_splits = 0;
+
+    // Get the code for the value, adding it to the dictionary if it hasn't been seen before
+    static size_t encode(std::array<uint16_t, 256>& dict, std::string& vals, char val) {
+        auto& entry = dict[static_cast<unsigned char>(val)];
+        if (!entry) {
+            vals.push_back(val);
+            entry = static_cast<uint16_t>(vals.size());
+        }
+
+        return entry - 1;
+    }
+
+    // Create a leaf below a node that has taken the given attributes
+    uint32_t addLeaf(Vec<bool> taken, Vec<uint32_t> classes = {}) {
+        Node leaf;
+        leaf.taken = std::move(taken);
+        leaf.classes = std::move(classes);
+        leaf.stats.resize(leaf.taken.size());
+
+        nodes.push_back(std::move(leaf));
+        return static_cast<uint32_t>(nodes.size() - 1);
+    }
+
+    // Error of the leaf's examples when split on the attribute (same scale as computeError)
+    double splitError(const Counts& table, size_t siz) const {
+        double acc = 0;
+        for (size_t v{}; v != table.values; ++v) {
+            auto count = table.at(v);
+            auto num = std::accumulate(count, count + table.classes, size_t{});
+            if (!num) continue;
+
+            if (selector == ErrorMetric::PROB_ERROR)
+                acc += countMinorities(count, table.classes, num);
+            else
+                acc += entropy(count, table.classes, num, siz);
+        }
+
+        return acc / (selector == ErrorMetric::PROB_ERROR ? siz : 1);
+    }
+
+    // Split the leaf if its statistics show that the best attribute is better than the runner-up
+    void attemptSplit(uint32_t idx) {
+        auto& leaf = nodes[idx];
+        auto open = std::find(std::begin(leaf.taken), std::end(leaf.taken), false);
+        if (open == std::end(leaf.taken)) return;
+
+        // Every attribute's table sums up to the leaf's class counts
+        auto& first = leaf.stats[open - std::begin(leaf.taken)];
+        Vec<uint32_t> count(first.classes);
+        for (size_t v{}; v != first.values; ++v)
+            for (size_t c{}; c != first.classes; ++c) count[c] += first.at(v)[c];
+
+        auto err = computeError(count.data(), count.size(), leaf.seen, selector);
+        if (err == 0) return;
+
+        // Find the best and second best attributes
+        size_t best = -1;
+        double best_err = err, second_err = err;
+        for (size_t i{}; i != leaf.taken.size(); ++i) {
+            if (leaf.taken[i]) continue;
+
+            auto split_err = splitError(leaf.stats[i], leaf.seen);
+            if (split_err < best_err) {
+                second_err = best_err;
+                best_err = split_err;
+                best = i;
+            } else if (split_err < second_err) {
+                second_err = split_err;
+            }
+        }
+
+        // Both errors lie in [0, 1], so the range of the metric is 1
+        auto eps = std::sqrt(std::log(1 / delta) / (2. * leaf.seen));
+        if (best == size_t(-1) || (second_err - best_err <= eps && eps >= tie)) return;
+
+        // Split, seeding each child's class counts from the leaf's counts for that value
+        auto table = std::move(leaf.stats[best]);
+        auto taken = leaf.taken;
+        taken[best] = true;
+
+        leaf.decision = best;
+        leaf.children.assign(table.values, 0);
+        Vec<Counts>{}.swap(leaf.stats);
+
+        for (size_t v{}; v != table.values; ++v) {
+            Vec<uint32_t> prior{ table.at(v), table.at(v) + table.classes };
+            if (std::accumulate(std::begin(prior), std::end(prior), size_t{}))
+                nodes[idx].children[v] = addLeaf(taken, std::move(prior));
+        }
+
+        ++num_splits;
+    }
+
+    // Find the node that predicts the row, `row` holds the attribute values at `row[a * stride]`
+        // Stops early at internal nodes that have no child for the row's value
+    const Node& route(const char* row, size_t stride) const {
+        auto node = &nodes[0];
+        while (node->decision != size_t(-1)) {
+            auto code = codes[node->decision][static_cast<unsigned char>(row[node->decision * stride])];
+            if (!code || code > node->children.size() || !node->children[code - 1]) break;
+
+            auto& next = nodes[node->children[code - 1]];
+            if (std::accumulate(std::begin(next.classes), std::end(next.classes), size_t{}) == 0) break;
+            node = &next;
+        }
+
+        return *node;
+    }
+
+    public:
+        explicit StreamingTree(ErrorMetric selector) : selector{ selector } {}
+
+        size_t attributes() const { return codes.size(); }
+        size_t size() const { return nodes.size(); }
+        size_t splits() const { return num_splits; }
+
+        // Learn from one example of the form "c,a,a,...,a"
+            // The first example decides the number of attributes, returns false (and learns nothing) for lines that don't match it
+        bool update(std::string_view line) {
+            if (nodes.empty()) {
+                auto num_attrs = line.size() / 2;
+                codes.resize(num_attrs);
+                values.resize(num_attrs);
+                addLeaf(Vec<bool>(num_attrs));
+            }
+
+            if (line.size() / 2 != attributes()) return false;
+
+            auto cls = encode(class_codes, class_values, line[0]);
+
+            // Walk down to the example's leaf, growing branches for values that haven't been seen at a node
+            uint32_t idx = 0;
+            while (true) {
+                auto& node = nodes[idx];
+                if (node.classes.size() <= cls) node.classes.resize(cls + 1);
+                node.classes[cls]++;
+
+                if (node.decision == size_t(-1)) break;
+
+                auto val = encode(codes[node.decision], values[node.decision], line[2 * node.decision + 2]);
+                if (node.children.size() <= val) node.children.resize(val + 1);
+                if (!node.children[val]) {
+                    auto leaf = addLeaf(node.taken);
+                    nodes[idx].children[val] = leaf;
+                }
+
+                idx = nodes[idx].children[val];
+            }
+
+            // Update the leaf's statistics and check whether it's time to split
+            auto& leaf = nodes[idx];
+            for (size_t i{}; i != leaf.taken.size(); ++i)
+                if (!leaf.taken[i]) leaf.stats[i].add(encode(codes[i], values[i], line[2 * i + 2]), cls);
+
+            if (++leaf.seen % grace == 0) attemptSplit(idx);
+            return true;
+        }
+
+        void update(const Vec<std::string_view>& lines) {
+            for (auto line : lines) update(line);
+        }
+
+        // Classify a single row, the row's value for attribute `a` is `row[a * stride]`
+        char predict(const char* row, size_t stride = 1) const {
+            auto& node = route(row, stride);
+            return class_values[maxClass(node.classes.data(), node.classes.size()).first];
+        }
+
+        Vec<char> predict(const Vec<const char*>& rows, size_t stride = 1) const {
+            Vec<char> ret;
+            ret.reserve(rows.size());
+            for (auto row : rows) ret.push_back(predict(row, stride));
+            return ret;
+        }
+
+        // Prints the current tree
+        template <class Ostream>
+        Ostream& print(Ostream& s, uint32_t idx = 0, std::string buf="") const {
+            auto& node = nodes[idx];
+            if (buf.empty()) s << "\nInitial:";
+            if (node.decision == size_t(-1))
+                return s << "Decided " << class_values[maxClass(node.classes.data(), node.classes.size()).first] << '\n';
+
+            s << attr_names[node.decision] << '\n';
+            buf += ' ';
+            for (size_t v{}; v != node.children.size(); ++v) {
+                if (!node.children[v]) continue;
+
+                s << buf << values[node.decision][v] << ':';
+                print(s, node.children[v], buf);
+            }
+            return s;
+        }
+};
+
+
+// Find the data file in the arguments array (the first argument that isn't a flag)
+std::string getFileName(int argc, const char* argv[]) {
+    // Flags that are followed by a value
+    static const Vec<std::string> valued{ "-j", "-p", "-m", "-o", "-f", "-k", "-vote", "-seed", "-s", "-trace", "-trace-format" };
+
+    for (int i{1}; i < argc; ++i) {
+        if (std::find(std::begin(valued), std::end(valued), argv[i]) != std::end(valued)) ++i;
+        else if (argv[i][0] != '-') return argv[i];
+    }
+
+    return "";
+}
+
+// Read in all examples from the file
+ExampleStore readFile(const std::string& file) {
+    std::ifstream o{ file };
+
+    // Read in the examples from the file
+    ExampleStore ret;
+    if (o) {
+        std::string line;
+        while (std::getline(o, line))
+            ret.push_back(line);
+    }
+
+    return ret;
+}
+
+// Call `fn(line, len, line_num)` for every non-empty line of the mapped file (without its line ending)
+template <class Fn>
+void forEachLine(const MappedFile& map, Fn&& fn) {
+    auto iter = map.data();
+    const auto end = iter + map.size();
+
+    for (size_t line_num{ 1 }; iter != end; ++line_num) {
+        auto eol = static_cast<const char*>(std::memchr(iter, '\n', end - iter));
+        if (!eol) eol = end;
+
+        auto line = iter;
+        auto len = static_cast<size_t>(eol - iter);
+        iter = eol == end ? end : eol + 1;
+
+        if (len && line[len - 1] == '\r') --len;
+        if (len) fn(line, len, line_num);
+    }
+}
+
+// Check that every value in the line is a single char, with the values separated by commas
+bool wellFormed(const char* line, size_t len) {
+    bool ok = len % 2;
+    for (size_t i{ 1 }; ok && i < len; i += 2)
+        ok = line[i] == ',' && line[i + 1] != ',';
+
+    return ok;
+}
+
+// Map the file into memory and parse the examples straight out of the mapping
+    // Malformed lines are skipped and reported to `errs` with their line numbers
+ExampleStore loadFile(const std::string& file, std::ostream& errs) {
+    ExampleStore ret;
+
+    MappedFile map{ file };
+    if (!map) return ret;
+
+    // Good lines are collected into blocks that are added a column at a time
+        // The block is kept small enough that its lines stay in L1 while every column is filled
+    Vec<const char*> block;
+    block.reserve(512);
+
+    size_t num_attrs = -1;
+    forEachLine(map, [&](const char* line, size_t len, size_t line_num) {
+        if (!wellFormed(line, len)) {
+            errs << file << ':' << line_num << ": expected single-char values separated by commas\n";
+            return;
+        }
+
+        // The first good line decides the number of attributes (and how much space to reserve)
+        if (num_attrs == size_t(-1)) {
+            num_attrs = len / 2;
+            ret.reserve(map.size() / (len + 1) + 1, num_attrs);
+        }
+
+        if (len / 2 != num_attrs) {
+            errs << file << ':' << line_num << ": expected " << num_attrs << " attributes, found " << len / 2 << '\n';
+            return;
+        }
+
+        block.push_back(line);
+        if (block.size() == block.capacity()) {
+            ret.append(block.data(), block.size());
+            block.clear();
+        }
+    });
+
+    ret.append(block.data(), block.size());
+    return ret;
+}
+
+// Compare the time taken by the getline based and memory-mapped loaders
+void benchLoad(const std::string& file) {
+    using clock = std::chrono::steady_clock;
+
+    auto time = [](auto&& fn) {
+        double best = std::numeric_limits<double>::max();
+        for (int i{}; i != 5; ++i) {
+            auto start = clock::now();
+            fn();
+            best = std::min(best, std::chrono::duration<double>(clock::now() - start).count());
+        }
+        return best;
+    };
+
+    size_t rows[2];
+    std::ostringstream errs;
+    auto read_t = time([&] { rows[0] = readFile(file).size(); });
+    auto load_t = time([&] { rows[1] = loadFile(file, errs).size(); });
+
+    auto mb = MappedFile{ file }.size() / double(1 << 20);
+    std::cout << std::fixed << std::setprecision(3)
+              << "readFile: " << rows[0] << " rows in " << read_t << "s (" << mb / read_t << " MB/s)\n"
+              << "loadFile: " << rows[1] << " rows in " << load_t << "s (" << mb / load_t << " MB/s)\n"
+              << "speedup:  " << read_t / load_t << "x\n";
+}
+
+// Example as it was stored before the column store, used as the partitioning baseline
+struct LegacyExample {
+    char classification;
+    Vec<char> attributes;
+
+    // Count the swaps made by std::partition
+    inline static size_t swaps = 0;
+
+    friend void swap(LegacyExample& a, LegacyExample& b) {
+        ++swaps;
+        std::swap(a.classification, b.classification);
+        a.attributes.swap(b.attributes);
+    }
+};
+
+// Compare partitioning whole examples with a std::partition per value against the counting sort over indices
+    // Level k of the "tree" splits every range of level k - 1 on attribute k, whatever the error is
+void benchPartition(const std::string& file) {
+    using clock = std::chrono::steady_clock;
+    using Range = std::pair<size_t, size_t>;
+
+    auto exs = loadFile(file, std::cerr);
+    if (!exs.size()) return void(std::cout << "No data read from " << file << '\n');
+    if (!counting_allocations) std::cout << "(allocation counts are 0, build with -DDEC_TREE_COUNT_ALLOCS to count them)\n";
+
+    Vec<LegacyExample> legacy(exs.size());
+    for (size_t ex{}; ex != exs.size(); ++ex) {
+        legacy[ex].classification = exs.classification(ex);
+        for (size_t a{}; a != exs.attributes(); ++a)
+            legacy[ex].attributes.push_back(exs.attribute(ex, a));
+    }
+
+    Vec<uint32_t> rows(exs.size()), scratch(exs.size());
+    std::iota(std::begin(rows), std::end(rows), uint32_t{});
+
+    // The old partition, moving whole examples once per distinct value
+    auto split_legacy = [&legacy](size_t dec, size_t l, size_t r, Vec<Range>& out) {
+        Map<char, size_t> attr_vals;
+        for (size_t ex{ l }; ex != r; ++ex)
+            attr_vals[legacy[ex].attributes[dec]] = true;
+
+        auto begin = std::begin(legacy);
+        auto iter = begin + l;
+        for (const auto& pair : attr_vals) {
+            auto next = std::partition(iter, begin + r,
+                [dec, val=pair.first](const LegacyExample& e) { return e.attributes[dec] == val; });
+            out.emplace_back(iter - begin, next - begin);
+            iter = next;
+        }
+    };
+
+    auto split_sort = [&](size_t dec, size_t l, size_t r, Vec<Range>& out) {
+        auto split = partition(exs, rows, scratch, dec, l, r);
+        for (size_t i{}, start{ l }; i != split.count; start = split.ends[i++])
+            out.emplace_back(start, split.ends[i]);
+    };
+
+    // Run every level with one of the partitions, reporting the work done by the partitioning alone
+    auto run = [&](const char* name, auto&& split, auto&& moved) {
+        Vec<Range> ranges{ { 0, exs.size() } }, next;
+        ranges.reserve(exs.size());
+        next.reserve(exs.size());
+
+        std::cout << name << '\n';
+        for (size_t level{}; level != std::min<size_t>(8, exs.attributes()); ++level) {
+            size_t allocs{}, bytes{};
+            double secs{};
+            for (auto [l, r] : ranges) {
+                if (r - l < 2) continue;
+
+                auto before = allocationCount();
+                auto start = clock::now();
+                split(level, l, r, next);
+                secs += std::chrono::duration<double>(clock::now() - start).count();
+                allocs += allocationCount() - before;
+                bytes += moved(l, r);
+            }
+
+            std::cout << "  level " << level << ": " << std::setw(7) << ranges.size() << " nodes, "
+                      << std::setw(11) << bytes << " bytes moved, " << std::setw(7) << allocs << " allocations, "
+                      << std::fixed << std::setprecision(3) << secs * 1000 << "ms\n";
+            std::swap(ranges, next);
+            next.clear();
+        }
+    };
+
+    // A swap writes two examples, the counting sort writes every index to the scratch and back
+    run("std::partition on examples:", split_legacy, [](size_t, size_t) {
+        auto bytes = LegacyExample::swaps * 2 * sizeof(LegacyExample);
+        LegacyExample::swaps = 0;
+        return bytes;
+    });
+    run("counting sort on indices:", split_sort, [](size_t l, size_t r) { return (r - l) * 2 * sizeof(uint32_t); });
+}
+
+// Compare the class-count and entropy kernels of every supported instruction set against the scalar reference
+    // The rows are shuffled, so the reference has to gather like it would for a node deep in the tree
+void benchKernels(const std::string& file) {
+    using clock = std::chrono::steady_clock;
+
+    auto time = [](auto&& fn) {
+        double best = std::numeric_limits<double>::max();
+        for (int i{}; i != 5; ++i) {
+            auto start = clock::now();
+            fn();
+            best = std::min(best, std::chrono::duration<double>(clock::now() - start).count());
+        }
+        return best;
+    };
+
+    auto exs = loadFile(file, std::cerr);
+    if (!exs.size()) return void(std::cout << "No data read from " << file << '\n');
+
+    auto n = exs.size();
+    auto num_classes = exs.classifications().cardinality();
+
+    SplitMix rng{ 42 };
+    Vec<uint32_t> rows(n);
+    std::iota(std::begin(rows), std::end(rows), uint32_t{});
+    for (size_t i{ n - 1 }; i; --i) std::swap(rows[i], rows[rng.below(i + 1)]);
+
+    Vec<uint8_t> labels(n);
+    for (size_t i{}; i != n; ++i) labels[i] = exs.classifications()[rows[i]];
+
+    // Counting the classes of all rows
+    std::array<uint32_t, 256> ref{};
+    auto ref_t = time([&] { ref = countClasses(exs, rows, 0, n); });
+    std::cout << std::fixed << std::setprecision(3) << "class counts over " << n << " rows:\n"
+              << "  reference: " << ref_t * 1000 << "ms\n";
+
+    for (auto& k : kernel_sets) {
+        if (!k.supported()) continue;
+
+        std::array<uint32_t, 256> count{};
+        auto t = time([&] { count.fill(0); k.countCodes(labels.data(), n, num_classes, count.data()); });
+        std::cout << "  " << std::setw(9) << k.name << ": " << t * 1000 << "ms (" << ref_t / t << "x)"
+                  << (count == ref ? "" : " MISMATCH") << '\n';
+    }
+
+    // Entropy terms of many histogram cells, as produced by the splits of a whole level of nodes
+    Vec<uint32_t> sums(n), maxes(n);
+    Vec<double> ref_terms(n), terms(n);
+    for (size_t i{}; i != n; ++i) {
+        sums[i] = static_cast<uint32_t>(rng.below(1000));
+        maxes[i] = static_cast<uint32_t>(sums[i] ? sums[i] / 2 + rng.below(sums[i] / 2 + 1) : 0);
+    }
+
+    ref_t = time([&] {
+        for (size_t i{}; i != n; ++i) {
+            uint32_t count[2] = { maxes[i], sums[i] - maxes[i] };
+            ref_terms[i] = sums[i] ? entropy(count, 2, sums[i], n) : 0;
+        }
+    });
+    std::cout << "entropy terms of " << n << " cells:\n"
+              << "  reference: " << ref_t * 1000 << "ms\n";
+
+    for (auto& k : kernel_sets) {
+        if (!k.supported()) continue;
+
+        auto t = time([&] { k.entropyTerms(sums.data(), maxes.data(), n, double(n), terms.data()); });
+
+        double err = 0;
+        for (size_t i{}; i != n; ++i) err = std::max(err, std::abs(terms[i] - ref_terms[i]) / std::max(ref_terms[i], 1e-300));
+        std::cout << "  " << std::setw(9) << k.name << ": " << t * 1000 << "ms (" << ref_t / t << "x), "
+                  << std::scientific << std::setprecision(2) << err << " max relative error\n"
+                  << std::fixed << std::setprecision(3);
+    }
+}
+
+// Predict every example in the file with the model (or forest), reporting the accuracy and prediction rate
+template <class Predictor>
+void evaluate(const Predictor& model, const std::string& file) {
+    MappedFile map{ file };
+    if (!map) return void(std::cout << "No data read from " << file << '\n');
+
+    // Point straight into the mapped lines, the values of each row sit two chars apart
+    Vec<const char*> rows;
+    Vec<char> actual;
+
+    forEachLine(map, [&](const char* line, size_t len, size_t line_num) {
+        if (len < 2 * model.attributes() + 1) {
+            std::cerr << file << ':' << line_num << ": expected " << model.attributes() << " attributes\n";
+            return;
+        }
+
+        actual.push_back(line[0]);
+        rows.push_back(line + 2);
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    auto predicted = model.predict(rows, 2);
+    auto secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t correct{};
+    for (size_t i{}; i != rows.size(); ++i)
+        correct += predicted[i] == actual[i];
+
+    std::cout << std::fixed << std::setprecision(3)
+              << "Predicted " << rows.size() << " examples in " << secs << "s ("
+              << rows.size() / secs << "/s), accuracy = " << 100. * correct / rows.size() << "%\n";
+}
+
+// Get the error metric to use (find a '-e' in the arguments array)
+ErrorMetric getErrorMetric(int argc, const char* argv[]) {
+    for (int i{}; i != argc; ++i)
+        if (argv[i] == std::string{"-e"}) return ErrorMetric::ENTROPY;
+    return ErrorMetric::PROB_ERROR;
+}
+
+// Get the forest settings (find '-f TREES', '-k FEATURES', '-vote majority|prob' and '-seed N' in the arguments array)
+ForestOptions getForestOptions(int argc, const char* argv[]) {
+    ForestOptions ret;
+    for (int i{}; i + 1 < argc; ++i) {
+        if (argv[i] == std::string{"-f"}) ret.trees = std::stoul(argv[i + 1]);
+        else if (argv[i] == std::string{"-k"}) ret.features = std::stoul(argv[i + 1]);
+        else if (argv[i] == std::string{"-seed"}) ret.seed = std::stoull(argv[i + 1]);
+        else if (argv[i] == std::string{"-vote"}) ret.vote = argv[i + 1] == std::string{"prob"} ? Vote::PROBABILITY : Vote::MAJORITY;
+    }
+    return ret;
+}
+
+// Get the number of threads to train with (find a '-j N' in the arguments array)
+size_t getThreadCount(int argc, const char* argv[]) {
+    for (int i{}; i + 1 < argc; ++i)
+        if (argv[i] == std::string{"-j"}) return std::max(std::stoul(argv[i + 1]), 1ul);
+    return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+// Get the number of examples per batch when learning incrementally (find a '-s BATCH' in the arguments array)
+size_t getStreamBatch(int argc, const char* argv[]) {
+    for (int i{}; i + 1 < argc; ++i)
+        if (argv[i] == std::string{"-s"}) return std::stoul(argv[i + 1]);
+    return 0;
+}
+
+// Get the file of examples to predict with the trained model (find a '-p FILE' in the arguments array)
+std::string getPredictFile(int argc, const char* argv[]) {
+    for (int i{}; i + 1 < argc; ++i)
+        if (argv[i] == std::string{"-p"}) return argv[i + 1];
+    return "";
+}
+
+// Get the file to load a saved model from instead of training (find a '-m FILE' in the arguments array)
+std::string getModelFile(int argc, const char* argv[]) {
+    for (int i{}; i + 1 < argc; ++i)
+        if (argv[i] == std::string{"-m"}) return argv[i + 1];
+    return "";
+}
+
+// Get the file to save the trained model to (find a '-o FILE' in the arguments array)
+std::string getOutputFile(int argc, const char* argv[]) {
+    for (int i{}; i + 1 < argc; ++i)
+        if (argv[i] == std::string{"-o"}) return argv[i + 1];
+    return "";
+}
+
+// Get the file to write the training trace to (find a '-trace FILE' in the arguments array)
+std::string getTraceFile(int argc, const char* argv[]) {
+    for (int i{}; i + 1 < argc; ++i)
+        if (argv[i] == std::string{"-trace"}) return argv[i + 1];
+    return "";
+}
+
+// Get the format of the training trace (find a '-trace-format chrome|json' in the arguments array)
+TraceFormat getTraceFormat(int argc, const char* argv[]) {
+    for (int i{}; i + 1 < argc; ++i)
+        if (argv[i] == std::string{"-trace-format"}) return argv[i + 1] == std::string{"json"} ? TraceFormat::JSON : TraceFormat::CHROME;
+    return TraceFormat::CHROME;
+}
+
+// Check whether the loader benchmark was requested (find a '-bench' in the arguments array)
+bool getBenchmark(int argc, const char* argv[]) {
+    for (int i{}; i != argc; ++i)
+        if (argv[i] == std::string{"-bench"}) return true;
+    return false;
+}
+
+// Check whether the kernel benchmark was requested (find a '-bench-kernels' in the arguments array)
+bool getKernelBenchmark(int argc, const char* argv[]) {
+    for (int i{}; i != argc; ++i)
+        if (argv[i] == std::string{"-bench-kernels"}) return true;
+    return false;
+}
+
+// Check whether the partition benchmark was requested (find a '-bench-partition' in the arguments array)
+bool getPartitionBenchmark(int argc, const char* argv[]) {
+    for (int i{}; i != argc; ++i)
+        if (argv[i] == std::string{"-bench-partition"}) return true;
+    return false;
+}
+
+// Train a tree on the examples in the file, print it and compile it into a model
+    // The examples and the tree are released once the model has been compiled
+Model train(const std::string& file, ErrorMetric selector, TaskPool& pool, TrainTrace* trace) {
+    auto examples = loadFile(file, std::cerr);
+    if (examples.size() == 0) return {};
+
+    // The tree only ever reorders the example indices
+    Vec<uint32_t> rows(examples.size());
+    std::iota(std::begin(rows), std::end(rows), uint32_t{});
+
+    DecTree tree{ examples, rows, selector, pool, 0, 0, trace };
+    tree.print(std::cout, examples);
+
+    return { tree, examples, attr_names };
+}
+
+// Train a forest on the examples in the file
+Forest trainForest(const std::string& file, const ForestOptions& opts, ErrorMetric selector, TaskPool& pool, TrainTrace* trace) {
+    auto examples = loadFile(file, std::cerr);
+    return { examples, examples.size() ? opts : ForestOptions{}, selector, pool, trace };
+}
+
+// Feed the examples in the file to a streaming tree in batches, reporting the tree's growth after every batch
+StreamingTree trainStream(const std::string& file, size_t batch, ErrorMetric selector) {
+    StreamingTree tree{ selector };
+
+    MappedFile map{ file };
+    if (!map) return tree;
+
+    Vec<std::string_view> lines;
+    size_t num_attrs = -1, batches = 0;
+
+    auto learn = [&] {
+        tree.update(lines);
+        std::cout << "Batch " << ++batches << ": " << lines.size() << " examples, "
+                  << tree.size() << " nodes, " << tree.splits() << " splits\n";
+        lines.clear();
+    };
+
+    forEachLine(map, [&](const char* line, size_t len, size_t line_num) {
+        if (num_attrs == size_t(-1)) num_attrs = len / 2;
+        if (!wellFormed(line, len) || len / 2 != num_attrs) {
+            std::cerr << file << ':' << line_num << ": expected " << num_attrs << " single-char attributes separated by commas\n";
+            return;
+        }
+
+        lines.emplace_back(line, len);
+        if (lines.size() == batch) learn();
+    });
+
+    if (!lines.empty()) learn();
+    return tree;
+}
+
+// Run the decision tree program
+int main(int argc, const char* argv[]) {
+    auto file = getFileName(argc, argv);
+    if (getBenchmark(argc, argv)) return benchLoad(file), 0;
+    if (getPartitionBenchmark(argc, argv)) return benchPartition(file), 0;
+    if (getKernelBenchmark(argc, argv)) return benchKernels(file), 0;
+
+    auto predict = getPredictFile(argc, argv);
+
+    // Learn incrementally instead of training on everything at once
+    if (auto batch = getStreamBatch(argc, argv)) {
+        auto tree = trainStream(file, batch, getErrorMetric(argc, argv));
+        if (!tree.size()) return (std::cout << "No data read from the given file\n"), 0;
+
+        tree.print(std::cout);
+        if (!predict.empty()) evaluate(tree, predict);
+        return 0;
+    }
+
+    // Record the training work when asked to, the trace is written once training is done
+    auto trace_file = getTraceFile(argc, argv);
+    auto save_trace = [&](const TrainTrace& trace) {
+        if (!trace_file.empty() && !trace.save(trace_file, getTraceFormat(argc, argv)))
+            std::cerr << trace_file << ": could not write the trace\n";
+    };
+
+    // Train an ensemble instead of a single tree
+    if (auto opts = getForestOptions(argc, argv); opts.trees) {
+        TaskPool pool{ getThreadCount(argc, argv) };
+        TrainTrace trace{ pool.size() };
+        auto forest = trainForest(file, opts, getErrorMetric(argc, argv), pool, trace_file.empty() ? nullptr : &trace);
+        if (!forest.size()) return (std::cout << "No data read from the given file\n"), 0;
+
+        save_trace(trace);
+        std::cout << "Trained " << forest.size() << " trees\n";
+        if (!predict.empty()) evaluate(forest, predict);
+        return 0;
+    }
+
+    // Either map a saved model or train a new one
+    Model model;
+    if (auto saved = getModelFile(argc, argv); !saved.empty()) {
+        model = Model::load(saved, std::cerr);
+        if (!model) return 1;
+    } else {
+        TaskPool pool{ getThreadCount(argc, argv) };
+        TrainTrace trace{ pool.size() };
+        model = train(file, getErrorMetric(argc, argv), pool, trace_file.empty() ? nullptr : &trace);
+        if (!model) return (std::cout << "No data read from the given file\n"), 0;
+
+        save_trace(trace);
+    }
+
+    auto output = getOutputFile(argc, argv);
+    if (!output.empty() && !model.save(output)) std::cerr << output << ": could not write the model\n";
+
+    if (!predict.empty()) evaluate(model, predict);
 }